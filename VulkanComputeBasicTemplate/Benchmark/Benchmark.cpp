@@ -0,0 +1,1287 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include "ComputeClient.h"
+#include "ComputeGraph.h"
+#include "ComputeServer.h"
+#include "DescriptorAllocator.h"
+#include "MappedFile.h"
+#include "Primitives.h"
+#include "StreamProcessor.h"
+#include "PipelineBuilder.h"
+#include "ThreadPool.h"
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+static double secondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static double median(std::vector<double> values)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static std::string escapeJson(const std::string& str)
+{
+    std::string escaped;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if ((unsigned char)c >= 0x20)
+            escaped += c;
+    }
+    return escaped;
+}
+
+static void fillCalculations(Calculation* calculations, uint32_t elementCount, uint32_t seed)
+{
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        calculations[i].f1 = (float)(i + seed);
+        calculations[i].f2 = (float)i * 0.5f;
+        calculations[i].res = 0.f;
+    }
+}
+
+static void fillCalculations(std::vector<Calculation>& calculations, uint32_t seed)
+{
+    fillCalculations(calculations.data(), static_cast<uint32_t>(calculations.size()), seed);
+}
+
+// Median seconds of c = a + b as a one stage graph over elements of T, including the transfers
+template<typename T>
+static double timePackedAdd(Application& app, const char* elementMacro, std::vector<T>& a, std::vector<T>& b,
+                            std::vector<T>& c, uint32_t iterations)
+{
+    typedef ComputeGraph::BufferKind Kind;
+    uint32_t elementCount = static_cast<uint32_t>(c.size());
+    ComputeGraph graph(app);
+    if (elementMacro)
+        graph.setShaderOptions({ { elementMacro, "1" } });
+    ComputeGraph::BufferId aBuffer = graph.addTypedBuffer("a", elementCount, Kind::Input, a.data());
+    ComputeGraph::BufferId bBuffer = graph.addTypedBuffer("b", elementCount, Kind::Input, b.data());
+    ComputeGraph::BufferId cBuffer = graph.addTypedBuffer("c", elementCount, Kind::Output, c.data());
+    graph.addStage("../Shaders/graphAddPacked.glsl", { { aBuffer, false }, { bBuffer, false }, { cBuffer, true } },
+                   (elementCount + 255) / 256);
+    graph.compile();
+    graph.run();
+
+    std::vector<double> samples;
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        graph.run();
+        samples.push_back(secondsSince(start));
+    }
+    return median(samples);
+}
+
+Benchmark::Benchmark(Application& app, bool quick)
+    : m_app(app), m_quick(quick)
+{
+}
+
+void Benchmark::record(const std::string& name, const Params& params, double value, const std::string& unit)
+{
+    m_results.push_back({ name, params, value, unit });
+
+    std::cerr << "  " << name;
+    for (const auto& param : params)
+        std::cerr << " " << param.first << "=" << param.second;
+    std::cerr << ": " << value << " " << unit << std::endl;
+}
+
+void Benchmark::runAll()
+{
+    m_app.setup();
+    std::cerr << "Benchmarking " << m_app.m_deviceProperties.deviceName << (m_quick ? " (quick)" : "") << std::endl;
+
+    emptyDispatchLatency();
+    submitToFenceLatency();
+    smallBatchLatency();
+    transferBandwidth();
+    throughputByProblemSize();
+    throughputByWorkgroupSize();
+    allocationLatency();
+    mappingLatency();
+    asyncDepthThroughput();
+    recordingCost();
+    graphChainLatency();
+    indirectChainLatency();
+    pipelineStartupByThreads();
+    ingestion();
+    streamingThroughput();
+    descriptorBindingCost();
+    primitivesThroughput();
+    packedStorageAdd();
+    serverJobLatency();
+
+    m_app.shutdown();
+}
+
+uint32_t Benchmark::acquireFrame()
+{
+    uint32_t slot = m_app.m_submissionRing.acquire();
+    Application::Frame& frame = m_app.m_frames[slot];
+    m_app.retireFrame(frame);
+
+    // Make computeBatchAsync record the frame again next time it gets this slot
+    frame.commandsRecorded = false;
+    return slot;
+}
+
+double Benchmark::submitAndWait(uint32_t slot, const std::function<void(VkCommandBuffer)>& recordCommands)
+{
+    SubmissionRing& ring = m_app.m_submissionRing;
+    VkCommandBuffer commandBuffer = ring.getCommandBuffer(slot);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
+                    "Failed to begin command buffer");
+    recordCommands(commandBuffer);
+    CHECK_VK_RESULT(vkEndCommandBuffer(commandBuffer),
+                    "Failed to end command buffer");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    ring.wait(ring.submit(slot));
+    return secondsSince(start);
+}
+
+void Benchmark::emptyDispatchLatency()
+{
+    // A single workgroup over a buffer that holds exactly one workgroup's elements
+    uint32_t slot = acquireFrame();
+    Application::Frame& frame = m_app.m_frames[slot];
+    m_app.reserveDataBuffer(frame, m_app.m_workgroupSize);
+
+    auto recordDispatch = [&](VkCommandBuffer commandBuffer) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_app.m_pipeline);
+        m_app.cmdBindDataBuffer(commandBuffer, frame);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+    };
+
+    uint32_t iterations = m_quick ? 200 : 2000;
+    std::vector<double> samples;
+    for (uint32_t i = 0; i < iterations; ++i)
+        samples.push_back(submitAndWait(slot, recordDispatch));
+
+    record("empty_dispatch_latency", { { "iterations", iterations } }, median(samples) * 1e6, "us");
+}
+
+void Benchmark::submitToFenceLatency()
+{
+    uint32_t iterations = m_quick ? 200 : 2000;
+    std::vector<double> samples;
+    uint32_t slot = acquireFrame();
+    for (uint32_t i = 0; i < iterations; ++i)
+        samples.push_back(submitAndWait(slot, [](VkCommandBuffer) {}));
+
+    record("submit_to_fence_latency", { { "iterations", iterations } }, median(samples) * 1e6, "us");
+}
+
+void Benchmark::smallBatchLatency()
+{
+    uint32_t iterations = m_quick ? 200 : 2000;
+
+    for (uint32_t elementCount : { 1u, Application::maxSmallBatchSize })
+    {
+        std::vector<Calculation> calculations(elementCount);
+        fillCalculations(calculations, 0);
+
+        // Push constants, then the regular upload, dispatch and readback through the frame buffers
+        std::vector<double> pushSamples, bufferSamples;
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            m_app.computeSmallBatch(calculations.data(), elementCount);
+            pushSamples.push_back(secondsSince(start));
+
+            start = std::chrono::high_resolution_clock::now();
+            m_app.computeBatch(calculations);
+            bufferSamples.push_back(secondsSince(start));
+        }
+
+        record("small_batch_latency_push_constants", { { "elements", elementCount } }, median(pushSamples) * 1e6, "us");
+        record("small_batch_latency_buffer", { { "elements", elementCount } }, median(bufferSamples) * 1e6, "us");
+    }
+}
+
+void Benchmark::transferBandwidth()
+{
+    VkDeviceSize size = (m_quick ? 16ull : 256ull) * 1024 * 1024;
+    size = std::min<VkDeviceSize>(size, m_app.m_deviceProperties.limits.maxStorageBufferRange);
+
+    Buffer staging = m_app.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, BufferUsage::Staging);
+    Buffer device = m_app.createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                       BufferUsage::GpuOnly);
+    std::vector<char> host(size, 7);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = size;
+
+    uint32_t iterations = m_quick ? 3 : 10;
+    std::vector<double> uploadSamples, downloadSamples;
+    uint32_t slot = acquireFrame();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        // Host memcpy into the staging buffer plus the copy into the working buffer
+        auto start = std::chrono::high_resolution_clock::now();
+        memcpy(mappedSpan<char>(staging).data(), host.data(), size);
+        m_app.m_memoryArena.flush(staging.allocation);
+        submitAndWait(slot, [&](VkCommandBuffer commandBuffer) {
+            vkCmdCopyBuffer(commandBuffer, staging.buffer, device.buffer, 1, &copyRegion);
+        });
+        uploadSamples.push_back(secondsSince(start));
+
+        start = std::chrono::high_resolution_clock::now();
+        submitAndWait(slot, [&](VkCommandBuffer commandBuffer) {
+            vkCmdCopyBuffer(commandBuffer, device.buffer, staging.buffer, 1, &copyRegion);
+
+            VkBufferMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = staging.buffer;
+            barrier.size = VK_WHOLE_SIZE;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+        });
+        m_app.m_memoryArena.invalidate(staging.allocation);
+        memcpy(host.data(), mappedSpan<char>(staging).data(), size);
+        downloadSamples.push_back(secondsSince(start));
+    }
+
+    m_app.destroyBuffer(staging);
+    m_app.destroyBuffer(device);
+
+    double gigabytes = (double)size / 1e9;
+    record("upload_bandwidth", { { "bytes", (double)size } }, gigabytes / median(uploadSamples), "GB/s");
+    record("download_bandwidth", { { "bytes", (double)size } }, gigabytes / median(downloadSamples), "GB/s");
+}
+
+void Benchmark::throughputByProblemSize()
+{
+    uint32_t maxElements = m_app.m_deviceProperties.limits.maxStorageBufferRange / sizeof(Calculation);
+    uint32_t largest = std::min<uint32_t>(m_quick ? 1u << 20 : 1u << 24, maxElements);
+
+    for (uint32_t elementCount = 1 << 10; elementCount <= largest; elementCount *= 4)
+    {
+        std::vector<Calculation> calculations(elementCount);
+        fillCalculations(calculations, 0);
+        m_app.computeBatch(calculations);
+
+        std::vector<double> samples;
+        for (uint32_t i = 0; i < 5; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            m_app.computeBatch(calculations);
+            samples.push_back(secondsSince(start));
+        }
+
+        record("throughput_by_problem_size", { { "elements", elementCount }, { "workgroup_size", m_app.m_workgroupSize },
+                                                { "elements_per_invocation", m_app.m_elementsPerInvocation } },
+               elementCount / median(samples), "elements/s");
+    }
+}
+
+void Benchmark::throughputByWorkgroupSize()
+{
+    uint32_t elementCount = m_quick ? 1 << 18 : 1 << 22;
+    std::vector<Calculation> calculations(elementCount);
+    fillCalculations(calculations, 0);
+
+    uint32_t defaultWorkgroupSize = m_app.m_workgroupSize;
+    const VkPhysicalDeviceLimits& limits = m_app.m_deviceProperties.limits;
+
+    for (uint32_t workgroupSize = 32; workgroupSize <= 1024; workgroupSize *= 2)
+    {
+        if (workgroupSize > limits.maxComputeWorkGroupSize[0] || workgroupSize > limits.maxComputeWorkGroupInvocations)
+            break;
+
+        m_app.setWorkgroupSize(workgroupSize);
+        m_app.computeBatch(calculations);
+
+        std::vector<double> samples;
+        for (uint32_t i = 0; i < 5; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            m_app.computeBatch(calculations);
+            samples.push_back(secondsSince(start));
+        }
+
+        record("throughput_by_workgroup_size", { { "elements", elementCount }, { "workgroup_size", workgroupSize },
+                                                  { "elements_per_invocation", m_app.m_elementsPerInvocation } },
+               elementCount / median(samples), "elements/s");
+    }
+
+    m_app.setWorkgroupSize(defaultWorkgroupSize);
+}
+
+void Benchmark::allocationLatency()
+{
+    VkDevice device = m_app.m_device;
+    uint32_t bufferCount = m_quick ? 512 : 4096;
+
+    // Mixed sizes from 4 KiB to 1 MiB, the same sequence for both strategies
+    std::vector<VkDeviceSize> sizes(bufferCount);
+    uint32_t seed = 12345;
+    for (VkDeviceSize& size : sizes)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        size = (VkDeviceSize)4096 << ((seed >> 16) % 9);
+    }
+
+    std::vector<VkBuffer> buffers(bufferCount, VK_NULL_HANDLE);
+    auto createRawBuffer = [&](VkDeviceSize size) {
+        VkBufferCreateInfo bufferCreateInfo = {};
+        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferCreateInfo.size = size;
+        bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkBuffer buffer;
+        CHECK_VK_RESULT(vkCreateBuffer(device, &bufferCreateInfo, nullptr, &buffer),
+                        "Failed to create buffer");
+        return buffer;
+    };
+
+    // One vkAllocateMemory per buffer, capped well below maxMemoryAllocationCount
+    uint32_t dedicatedCount = std::min(bufferCount, m_app.m_deviceProperties.limits.maxMemoryAllocationCount / 2);
+    std::vector<VkDeviceMemory> memories(dedicatedCount, VK_NULL_HANDLE);
+    double dedicatedSeconds = 0.0;
+    for (uint32_t i = 0; i < dedicatedCount; ++i)
+    {
+        buffers[i] = createRawBuffer(sizes[i]);
+        VkMemoryRequirements memReq;
+        vkGetBufferMemoryRequirements(device, buffers[i], &memReq);
+
+        VkMemoryAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocateInfo.allocationSize = memReq.size;
+        allocateInfo.memoryTypeIndex = m_app.findMemoryType(memReq.memoryTypeBits, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        CHECK_VK_RESULT(vkAllocateMemory(device, &allocateInfo, nullptr, &memories[i]),
+                        "Failed to allocate buffer memory");
+        CHECK_VK_RESULT(vkBindBufferMemory(device, buffers[i], memories[i], 0),
+                        "Failed to bind buffer memory");
+        dedicatedSeconds += secondsSince(start);
+    }
+    for (uint32_t i = 0; i < dedicatedCount; ++i)
+    {
+        vkDestroyBuffer(device, buffers[i], nullptr);
+        vkFreeMemory(device, memories[i], nullptr);
+    }
+
+    // A separate arena so the application's own blocks do not skew the statistics
+    MemoryArena arena;
+    arena.init(device, m_app.m_deviceProperties, m_app.m_memoryProperties);
+
+    std::vector<Allocation> allocations(bufferCount);
+    double arenaSeconds = 0.0;
+    for (uint32_t i = 0; i < bufferCount; ++i)
+    {
+        buffers[i] = createRawBuffer(sizes[i]);
+        VkMemoryRequirements memReq;
+        vkGetBufferMemoryRequirements(device, buffers[i], &memReq);
+        uint32_t memoryTypeIndex = m_app.findMemoryType(memReq.memoryTypeBits, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        allocations[i] = arena.allocate(memReq, memoryTypeIndex);
+        CHECK_VK_RESULT(vkBindBufferMemory(device, buffers[i], allocations[i].memory, allocations[i].offset),
+                        "Failed to bind buffer memory");
+        arenaSeconds += secondsSince(start);
+    }
+
+    // Free every other buffer to punch holes into the blocks
+    for (uint32_t i = 0; i < bufferCount; i += 2)
+    {
+        vkDestroyBuffer(device, buffers[i], nullptr);
+        arena.free(allocations[i]);
+    }
+    MemoryArena::Stats stats = arena.getStats();
+
+    for (uint32_t i = 1; i < bufferCount; i += 2)
+    {
+        vkDestroyBuffer(device, buffers[i], nullptr);
+        arena.free(allocations[i]);
+    }
+    arena.destroy();
+
+    if (dedicatedCount > 0)
+        record("allocation_latency_dedicated", { { "buffers", dedicatedCount } }, dedicatedSeconds * 1e6 / dedicatedCount, "us");
+    record("allocation_latency_arena", { { "buffers", bufferCount } }, arenaSeconds * 1e6 / bufferCount, "us");
+    record("arena_fragmentation_after_half_free", { { "buffers", bufferCount }, { "blocks", stats.blockCount },
+                                                    { "free_ranges", stats.freeRangeCount } },
+           stats.fragmentation, "ratio");
+}
+
+void Benchmark::mappingLatency()
+{
+    VkDevice device = m_app.m_device;
+    const VkDeviceSize dataSize = 4096;
+    uint32_t iterations = m_quick ? 10000 : 100000;
+    std::vector<char> data(dataSize, 1);
+
+    Buffer buffer = m_app.createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, BufferUsage::Staging);
+
+    // Map, write, unmap on every transfer. Needs its own memory object since arena blocks are already mapped.
+    VkDeviceMemory unmappedMemory;
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = dataSize;
+    allocateInfo.memoryTypeIndex = buffer.allocation.memoryTypeIndex;
+    CHECK_VK_RESULT(vkAllocateMemory(device, &allocateInfo, nullptr, &unmappedMemory),
+                    "Failed to allocate memory");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        void* mappedMem = nullptr;
+        CHECK_VK_RESULT(vkMapMemory(device, unmappedMemory, 0, dataSize, 0, &mappedMem),
+                        "Failed to map memory");
+        memcpy(mappedMem, data.data(), dataSize);
+        vkUnmapMemory(device, unmappedMemory);
+    }
+    double mapUnmapSeconds = secondsSince(start);
+
+    // Persistently mapped, only a flush when the memory type is not coherent
+    start = std::chrono::high_resolution_clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        memcpy(mappedSpan<char>(buffer).data(), data.data(), dataSize);
+        m_app.m_memoryArena.flush(buffer.allocation);
+    }
+    double persistentSeconds = secondsSince(start);
+
+    bool coherent = buffer.allocation.coherent;
+    vkFreeMemory(device, unmappedMemory, nullptr);
+    m_app.destroyBuffer(buffer);
+
+    record("write_latency_map_unmap", { { "bytes", (double)dataSize } }, mapUnmapSeconds * 1e9 / iterations, "ns");
+    record("write_latency_persistent", { { "bytes", (double)dataSize }, { "coherent", coherent ? 1 : 0 } },
+           persistentSeconds * 1e9 / iterations, "ns");
+}
+
+void Benchmark::asyncDepthThroughput()
+{
+    uint32_t elementCount = m_quick ? 1 << 16 : 1 << 20;
+    const uint32_t batchCount = 32;
+    uint32_t defaultDepth = m_app.m_framesInFlight;
+
+    for (uint32_t depth = 1; depth <= 3; ++depth)
+    {
+        m_app.setFramesInFlight(depth);
+
+        // One host vector per frame in flight, the host fills batch N+1 while the GPU runs batch N
+        std::vector<std::vector<Calculation>> batches(depth, std::vector<Calculation>(elementCount));
+        std::vector<BatchHandle> handles(depth);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < batchCount; ++i)
+        {
+            uint32_t index = i % depth;
+            m_app.waitBatch(handles[index]);
+            fillCalculations(batches[index], i);
+            handles[index] = m_app.computeBatchAsync(batches[index]);
+        }
+        for (const BatchHandle& handle : handles)
+            m_app.waitBatch(handle);
+        double seconds = secondsSince(start);
+
+        record("async_throughput", { { "depth", depth }, { "elements", elementCount }, { "batches", batchCount } },
+               (double)elementCount * batchCount / seconds, "elements/s");
+    }
+
+    m_app.setFramesInFlight(defaultDepth);
+}
+
+void Benchmark::recordingCost()
+{
+    uint32_t elementCount = 1024;
+    uint32_t iterations = m_quick ? 200 : 2000;
+    std::vector<Calculation> batch(elementCount);
+    fillCalculations(batch, 0);
+
+    for (int reuse = 0; reuse < 2; ++reuse)
+    {
+        m_app.m_reuseRecordedCommands = reuse != 0;
+
+        // Only the host side of computeBatchAsync is timed, the wait for the GPU is excluded
+        double submitSeconds = 0.0;
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            BatchHandle handle = m_app.computeBatchAsync(batch);
+            submitSeconds += secondsSince(start);
+            m_app.waitBatch(handle);
+        }
+
+        record(reuse ? "submit_cpu_cost_record_once" : "submit_cpu_cost_rerecord", { { "elements", elementCount } },
+               submitSeconds * 1e6 / iterations, "us");
+    }
+
+    m_app.m_reuseRecordedCommands = true;
+}
+
+void Benchmark::graphChainLatency()
+{
+    typedef ComputeGraph::BufferKind Kind;
+    uint32_t elementCount = m_quick ? 1 << 18 : 1 << 22;
+    uint32_t groupCount = (elementCount + 255) / 256;
+    VkDeviceSize size = sizeof(float) * elementCount;
+    std::vector<float> input(elementCount, 1.f), factor(elementCount, 1.0001f), output(elementCount);
+
+    for (uint32_t stageCount : { 2u, 4u, 8u })
+    {
+        uint32_t iterations = m_quick ? 5 : 20;
+
+        // All stages in one submission, the intermediates alternate between two transient buffers
+        {
+            ComputeGraph graph(m_app);
+            ComputeGraph::BufferId previous = graph.addBuffer("input", size, Kind::Input, input.data());
+            ComputeGraph::BufferId factorBuffer = graph.addBuffer("factor", size, Kind::Input, factor.data());
+            for (uint32_t stage = 0; stage < stageCount; ++stage)
+            {
+                ComputeGraph::BufferId next = stage + 1 == stageCount
+                                              ? graph.addBuffer("output", size, Kind::Output, output.data())
+                                              : graph.addBuffer("intermediate", size, Kind::Transient);
+                graph.addStage("../Shaders/graphMul.glsl", { { previous, false }, { factorBuffer, false }, { next, true } }, groupCount);
+                previous = next;
+            }
+            graph.compile();
+            graph.run();
+
+            std::vector<double> samples;
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                graph.run();
+                samples.push_back(secondsSince(start));
+            }
+            record("graph_chain_single_submit", { { "elements", elementCount }, { "stages", stageCount },
+                                                  { "transient_buffers", graph.getTransientAllocationCount() } },
+                   median(samples) * 1e3, "ms");
+        }
+
+        // The same chain as one graph per stage, every intermediate goes through host memory
+        {
+            std::vector<float> intermediate(elementCount);
+            ComputeGraph graph(m_app);
+            ComputeGraph::BufferId in = graph.addBuffer("input", size, Kind::Input, intermediate.data());
+            ComputeGraph::BufferId factorBuffer = graph.addBuffer("factor", size, Kind::Input, factor.data());
+            ComputeGraph::BufferId out = graph.addBuffer("output", size, Kind::Output, output.data());
+            graph.addStage("../Shaders/graphMul.glsl", { { in, false }, { factorBuffer, false }, { out, true } }, groupCount);
+            graph.compile();
+
+            std::vector<double> samples;
+            for (uint32_t i = 0; i <= iterations; ++i)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                intermediate = input;
+                for (uint32_t stage = 0; stage < stageCount; ++stage)
+                {
+                    graph.run();
+                    if (stage + 1 < stageCount)
+                        intermediate = output;
+                }
+                // The first iteration warms up
+                if (i > 0)
+                    samples.push_back(secondsSince(start));
+            }
+            record("graph_chain_host_round_trips", { { "elements", elementCount }, { "stages", stageCount } },
+                   median(samples) * 1e3, "ms");
+        }
+    }
+}
+
+void Benchmark::indirectChainLatency()
+{
+    // Filter, then a pass sized by the filter's output. Half of the elements survive.
+    typedef ComputeGraph::BufferKind Kind;
+    uint32_t elementCount = m_quick ? 1 << 18 : 1 << 22;
+    uint32_t iterations = m_quick ? 5 : 20;
+    VkDeviceSize size = sizeof(float) * elementCount;
+    std::vector<float> input(elementCount), filteredHost(elementCount), output(elementCount);
+    for (uint32_t i = 0; i < elementCount; ++i)
+        input[i] = (i % 2) ? 1.f : -1.f;
+
+    // The second pass is dispatched from the arguments the first one wrote, one submission
+    {
+        uint32_t args[4] = { 0, 1, 1, 0 };
+        uint32_t count = 0;
+        ComputeGraph graph(m_app);
+        ComputeGraph::BufferId in = graph.addBuffer("input", size, Kind::Input, input.data());
+        ComputeGraph::BufferId argsBuffer = graph.addBuffer("args", sizeof(args), Kind::Input, args);
+        ComputeGraph::BufferId filtered = graph.addBuffer("filtered", size, Kind::Transient);
+        ComputeGraph::BufferId countBuffer = graph.addBuffer("count", sizeof(count), Kind::Output, &count);
+        ComputeGraph::BufferId out = graph.addBuffer("output", size, Kind::Output, output.data());
+        graph.addStage("../Shaders/graphFilter.glsl", { { in, false }, { filtered, true }, { argsBuffer, true } }, (elementCount + 255) / 256);
+        graph.addStage("../Shaders/graphDispatchArgs.glsl", { { argsBuffer, true }, { countBuffer, true } }, 1);
+        graph.addIndirectStage("../Shaders/graphScaleIndirect.glsl", { { filtered, false }, { argsBuffer, false }, { out, true } }, argsBuffer);
+        graph.compile();
+        graph.run();
+        if (count != elementCount / 2)
+            throw std::runtime_error("Indirect graph kept the wrong number of elements");
+
+        std::vector<double> samples;
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            graph.run();
+            samples.push_back(secondsSince(start));
+        }
+        record("indirect_chain_single_submit", { { "elements", elementCount }, { "kept", count } }, median(samples) * 1e3, "ms");
+    }
+
+    // The count and the filtered elements come back to the host, which sizes and submits the second pass
+    {
+        uint32_t args[4] = { 0, 1, 1, 0 };
+        uint32_t count = 0;
+        ComputeGraph filterGraph(m_app);
+        ComputeGraph::BufferId in = filterGraph.addBuffer("input", size, Kind::Input, input.data());
+        ComputeGraph::BufferId argsBuffer = filterGraph.addBuffer("args", sizeof(args), Kind::Input, args);
+        ComputeGraph::BufferId filtered = filterGraph.addBuffer("filtered", size, Kind::Output, filteredHost.data());
+        ComputeGraph::BufferId countBuffer = filterGraph.addBuffer("count", sizeof(count), Kind::Output, &count);
+        filterGraph.addStage("../Shaders/graphFilter.glsl", { { in, false }, { filtered, true }, { argsBuffer, true } }, (elementCount + 255) / 256);
+        filterGraph.addStage("../Shaders/graphDispatchArgs.glsl", { { argsBuffer, true }, { countBuffer, true } }, 1);
+        filterGraph.compile();
+
+        // The grid is baked into the recording. The count does not change between runs here, so the
+        // second graph is only compiled once, a real job would rebuild it whenever the count changes.
+        uint32_t scaleArgs[4] = { 0, 1, 1, 0 };
+        ComputeGraph scaleGraph(m_app);
+        ComputeGraph::BufferId scaleIn = scaleGraph.addBuffer("filtered", size, Kind::Input, filteredHost.data());
+        ComputeGraph::BufferId scaleArgsBuffer = scaleGraph.addBuffer("args", sizeof(scaleArgs), Kind::Input, scaleArgs);
+        ComputeGraph::BufferId out = scaleGraph.addBuffer("output", size, Kind::Output, output.data());
+
+        std::vector<double> samples;
+        for (uint32_t i = 0; i <= iterations; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            filterGraph.run();
+            scaleArgs[3] = count;
+            if (i == 0)
+            {
+                scaleGraph.addStage("../Shaders/graphScaleIndirect.glsl", { { scaleIn, false }, { scaleArgsBuffer, false }, { out, true } },
+                                    std::max(1u, (count + 255) / 256));
+                scaleGraph.compile();
+            }
+            scaleGraph.run();
+            // The first iteration warms up
+            if (i > 0)
+                samples.push_back(secondsSince(start));
+        }
+        record("indirect_chain_host_round_trip", { { "elements", elementCount }, { "kept", count } }, median(samples) * 1e3, "ms");
+    }
+}
+
+void Benchmark::writeJson(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to write " + path);
+
+    const VkPhysicalDeviceProperties& props = m_app.m_deviceProperties;
+    file << "{\n";
+    file << "  \"device\": {\"name\": \"" << escapeJson(props.deviceName) << "\", \"type\": " << props.deviceType
+         << ", \"vendorID\": " << props.vendorID << ", \"deviceID\": " << props.deviceID
+         << ", \"driverVersion\": " << props.driverVersion << ", \"apiVersion\": \""
+         << VK_VERSION_MAJOR(props.apiVersion) << "." << VK_VERSION_MINOR(props.apiVersion) << "\"},\n";
+    file << "  \"quick\": " << (m_quick ? "true" : "false") << ",\n";
+    file << "  \"results\": [";
+    for (size_t i = 0; i < m_results.size(); ++i)
+    {
+        const Result& result = m_results[i];
+        file << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.name << "\", \"params\": {";
+        for (size_t j = 0; j < result.params.size(); ++j)
+            file << (j == 0 ? "" : ", ") << "\"" << result.params[j].first << "\": " << result.params[j].second;
+        file << "}, \"value\": " << result.value << ", \"unit\": \"" << result.unit << "\"}";
+    }
+    file << "\n  ]\n}\n";
+}
+
+void Benchmark::pipelineStartupByThreads()
+{
+    // Kernel variants as the autotuner would build them. The VARIANT macro gives each one its
+    // own SPIR-V so every variant goes through shaderc.
+    const VkPhysicalDeviceLimits& limits = m_app.m_deviceProperties.limits;
+    std::vector<PipelineBuilder::ComputePipelineDesc> descs;
+    for (uint32_t workgroupSize = 32; workgroupSize <= 1024; workgroupSize *= 2)
+    {
+        if (workgroupSize > limits.maxComputeWorkGroupSize[0] || workgroupSize > limits.maxComputeWorkGroupInvocations)
+            break;
+        for (uint32_t elementsPerInvocation : { 1u, 2u, 4u, 8u })
+        {
+            PipelineBuilder::ComputePipelineDesc desc;
+            desc.shader = { "../Shaders/compShader.glsl", "compShader", VK_SHADER_STAGE_COMPUTE_BIT,
+                            { { "VARIANT", std::to_string(descs.size()) } } };
+            desc.layout = m_app.m_pipelineLayout;
+            desc.specializationConstants = { workgroupSize, elementsPerInvocation };
+            descs.push_back(desc);
+        }
+    }
+
+    uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threadCount = 1; threadCount < hardwareThreads; threadCount *= 2)
+        threadCounts.push_back(threadCount);
+    threadCounts.push_back(hardwareThreads);
+
+    // A fresh SPIR-V cache directory and no pipeline cache per run, so every run starts cold
+    SpirvCache& spirvCache = ShaderLoader::getSpirvCache();
+    std::string previousCacheDirectory = spirvCache.getDirectory();
+    std::string benchmarkCacheDirectory = "shader_cache_benchmark";
+
+    for (int batched = 0; batched < 2; ++batched)
+    {
+        if (m_quick && batched)
+            break;
+
+        for (uint32_t threadCount : threadCounts)
+        {
+            std::error_code ec;
+            std::filesystem::remove_all(benchmarkCacheDirectory, ec);
+            spirvCache.setDirectory(benchmarkCacheDirectory);
+
+            ThreadPool pool(threadCount);
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<VkPipeline> pipelines = PipelineBuilder::createComputePipelines(
+                m_app.m_shaderModuleCache, VK_NULL_HANDLE, descs, pool,
+                batched ? PipelineBuilder::Mode::Batched : PipelineBuilder::Mode::PerThread);
+            double seconds = secondsSince(start);
+
+            for (VkPipeline pipeline : pipelines)
+                vkDestroyPipeline(m_app.m_device, pipeline, nullptr);
+
+            record(batched ? "pipeline_startup_batched" : "pipeline_startup_per_thread",
+                   { { "threads", threadCount }, { "pipelines", static_cast<double>(descs.size()) } }, seconds * 1e3, "ms");
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(benchmarkCacheDirectory, ec);
+    spirvCache.setDirectory(previousCacheDirectory);
+}
+
+double Benchmark::timeBatch(Calculation* calculations, uint32_t elementCount, uint32_t iterations)
+{
+    std::vector<double> samples;
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        m_app.waitBatch(m_app.computeBatchAsync(calculations, elementCount));
+        samples.push_back(secondsSince(start));
+    }
+    return median(samples);
+}
+
+void Benchmark::ingestion()
+{
+    VkDeviceSize alignment = m_app.getHostImportAlignment();
+    if (alignment == 0)
+        std::cerr << "Host memory import not supported, only the staging path is measured" << std::endl;
+
+    uint32_t maxElements = m_app.m_deviceProperties.limits.maxStorageBufferRange / sizeof(Calculation);
+    uint32_t iterations = m_quick ? 3 : 10;
+    std::vector<uint32_t> elementCounts = { 1u << 16, 1u << 20 };
+    if (!m_quick)
+        elementCounts.push_back(1u << 24);
+
+    for (uint32_t elementCount : elementCounts)
+    {
+        elementCount = std::min(elementCount, maxElements);
+        VkDeviceSize dataSize = sizeof(Calculation) * elementCount;
+        VkDeviceSize allocationSize = alignment ? (dataSize + alignment - 1) / alignment * alignment : dataSize;
+
+        Calculation* calculations = static_cast<Calculation*>(m_app.m_hostMemoryImporter.allocate(allocationSize));
+        fillCalculations(calculations, elementCount, 0);
+
+        // Warm up the frame buffers before measuring
+        timeBatch(calculations, elementCount, 1);
+        Application::IngestionStats before = m_app.getIngestionStats();
+        double stagedSeconds = timeBatch(calculations, elementCount, iterations);
+        Application::IngestionStats after = m_app.getIngestionStats();
+        record("ingestion_staged", { { "elements", elementCount },
+                                     { "bytes_copied_per_batch", (double)(after.copiedBytes - before.copiedBytes) / iterations } },
+               stagedSeconds * 1e3, "ms");
+
+        before = m_app.getIngestionStats();
+        if (m_app.registerHostMemory(calculations, allocationSize))
+        {
+            double registerSeconds = m_app.getIngestionStats().importSeconds - before.importSeconds;
+            timeBatch(calculations, elementCount, 1);
+            double importedSeconds = timeBatch(calculations, elementCount, iterations);
+            after = m_app.getIngestionStats();
+            m_app.unregisterHostMemory(calculations);
+
+            record("ingestion_imported", { { "elements", elementCount },
+                                           { "bytes_copied_per_batch", (double)(after.copiedBytes - before.copiedBytes) / iterations } },
+                   importedSeconds * 1e3, "ms");
+            record("ingestion_import_registration", { { "elements", elementCount } }, registerSeconds * 1e3, "ms");
+        }
+
+        HostMemoryImporter::free(calculations);
+    }
+
+    // The same through a memory mapped file, imported when the mapping meets the alignment
+    uint32_t elementCount = std::min(m_quick ? 1u << 20 : 1u << 24, maxElements);
+    const char* path = "ingestion_benchmark.bin";
+    {
+        std::vector<Calculation> calculations(elementCount);
+        fillCalculations(calculations, 0);
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(calculations.data()), sizeof(Calculation) * calculations.size());
+    }
+    {
+        MappedFile mappedFile;
+        mappedFile.open(path);
+        Calculation* calculations = static_cast<Calculation*>(mappedFile.data());
+
+        bool imported = m_app.registerHostMemory(mappedFile.data(), mappedFile.getMappedSize());
+        timeBatch(calculations, elementCount, 1);
+        Application::IngestionStats before = m_app.getIngestionStats();
+        double seconds = timeBatch(calculations, elementCount, iterations);
+        Application::IngestionStats after = m_app.getIngestionStats();
+        if (imported)
+            m_app.unregisterHostMemory(mappedFile.data());
+
+        record("ingestion_mapped_file", { { "elements", elementCount }, { "imported", imported ? 1.0 : 0.0 },
+                                          { "bytes_copied_per_batch", (double)(after.copiedBytes - before.copiedBytes) / iterations } },
+               seconds * 1e3, "ms");
+    }
+    std::remove(path);
+}
+
+void Benchmark::streamingThroughput()
+{
+    // Larger than any single batch the other benchmarks run
+    uint64_t elementCount = m_quick ? 1ull << 22 : 1ull << 26;
+    uint32_t chunkElementCount = 1 << 20;
+    const char* inputPath = "stream_benchmark_input.bin";
+    const char* outputPath = "stream_benchmark_output.bin";
+    {
+        std::vector<Calculation> chunk(chunkElementCount);
+        std::ofstream file(inputPath, std::ios::binary | std::ios::trunc);
+        for (uint64_t written = 0; written < elementCount; written += chunkElementCount)
+        {
+            fillCalculations(chunk, static_cast<uint32_t>(written));
+            file.write(reinterpret_cast<const char*>(chunk.data()), sizeof(Calculation) * chunk.size());
+        }
+    }
+
+    uint32_t previousFramesInFlight = m_app.m_framesInFlight;
+    for (uint32_t depth : { 1u, 2u, 3u })
+    {
+        m_app.setFramesInFlight(depth);
+        StreamProcessor stream(m_app, chunkElementCount, depth);
+        StreamProcessor::Stats stats = stream.run(inputPath, outputPath);
+
+        record("streaming_throughput", { { "elements", static_cast<double>(elementCount) }, { "chunk_elements", chunkElementCount },
+                                         { "depth", depth }, { "peak_host_mib", stats.peakHostBytes / (1024.0 * 1024.0) } },
+               stats.getGigabytesPerSecond(), "GB/s");
+    }
+    m_app.setFramesInFlight(previousFramesInFlight);
+
+    // Spot check the last chunk of the output
+    {
+        std::ifstream file(outputPath, std::ios::binary);
+        Calculation last;
+        file.seekg(-static_cast<std::streamoff>(sizeof(Calculation)), std::ios::end);
+        file.read(reinterpret_cast<char*>(&last), sizeof(last));
+        if (!file || last.res != last.f1 + last.f2)
+            throw std::runtime_error("Streamed results do not match");
+    }
+
+    std::remove(inputPath);
+    std::remove(outputPath);
+}
+
+void Benchmark::descriptorBindingCost()
+{
+    // A job that binds a different buffer to every dispatch. Only the host cost of getting the
+    // binding into the command buffer is timed, nothing is submitted.
+    VkDevice device = m_app.m_device;
+    uint32_t bufferCount = 64;
+    uint32_t rounds = m_quick ? 100 : 1000;
+    VkDeviceSize bufferSize = sizeof(Calculation) * 256;
+
+    std::vector<Buffer> buffers(bufferCount);
+    for (Buffer& buffer : buffers)
+        buffer = m_app.createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, BufferUsage::GpuOnly);
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.queueFamilyIndex = m_app.m_computeQueueFamilyIndex;
+    VkCommandPool commandPool;
+    CHECK_VK_RESULT(vkCreateCommandPool(device, &commandPoolCreateInfo, nullptr, &commandPool),
+                    "Failed to create command pool");
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = commandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    CHECK_VK_RESULT(vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer),
+                    "Failed to allocate command buffer");
+
+    // Set layouts of their own, the application's layout is a push layout when the device supports it
+    VkDescriptorSetLayoutBinding layoutBinding = {};
+    layoutBinding.binding = 0;
+    layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    layoutBinding.descriptorCount = 1;
+    layoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bool push = m_app.m_cmdPushDescriptorSet != nullptr;
+    VkDescriptorSetLayout setLayouts[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    VkPipelineLayout pipelineLayouts[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+    for (uint32_t i = 0; i < (push ? 2u : 1u); ++i)
+    {
+        VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+        layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutCreateInfo.flags = i == 1 ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
+        layoutCreateInfo.bindingCount = 1;
+        layoutCreateInfo.pBindings = &layoutBinding;
+        CHECK_VK_RESULT(vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &setLayouts[i]),
+                        "Failed to create Descriptor set layout");
+
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+        pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutCreateInfo.setLayoutCount = 1;
+        pipelineLayoutCreateInfo.pSetLayouts = &setLayouts[i];
+        CHECK_VK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts[i]),
+                        "Failed to create pipeline layout");
+    }
+
+    // What the descriptor code did before the allocator, a fresh set per dispatch
+    VkDescriptorPoolSize descriptorPoolSize = {};
+    descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorPoolSize.descriptorCount = bufferCount;
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.maxSets = bufferCount;
+    descriptorPoolCreateInfo.poolSizeCount = 1;
+    descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+    VkDescriptorPool descriptorPool;
+    CHECK_VK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &descriptorPool),
+                    "Failed to create descriptor pool");
+
+    DescriptorAllocator allocator;
+    allocator.init(device);
+
+    auto timeRounds = [&](const std::function<void(const Buffer&)>& bind) {
+        double seconds = 0.0;
+        for (uint32_t round = 0; round < rounds; ++round)
+        {
+            CHECK_VK_RESULT(vkResetCommandPool(device, commandPool, 0),
+                            "Failed to reset command pool");
+            VkCommandBufferBeginInfo beginInfo = {};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
+                            "Failed to begin command buffer");
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (const Buffer& buffer : buffers)
+                bind(buffer);
+            seconds += secondsSince(start);
+
+            CHECK_VK_RESULT(vkEndCommandBuffer(commandBuffer),
+                            "Failed to end command buffer");
+        }
+        return seconds * 1e6 / (static_cast<double>(rounds) * bufferCount);
+    };
+
+    uint32_t round = 0;
+    double allocateSeconds = timeRounds([&](const Buffer& buffer) {
+        if (&buffer == &buffers.front() && round++ > 0)
+            vkResetDescriptorPool(device, descriptorPool, 0);
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &setLayouts[0];
+        VkDescriptorSet descriptorSet;
+        CHECK_VK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet),
+                        "Failed to allocate descriptor sets");
+
+        VkDescriptorBufferInfo descriptorBufferInfo = { buffer.buffer, 0, bufferSize };
+        VkWriteDescriptorSet writeDescriptorSet = {};
+        writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet.dstSet = descriptorSet;
+        writeDescriptorSet.dstBinding = 0;
+        writeDescriptorSet.descriptorCount = 1;
+        writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
+        vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts[0], 0, 1, &descriptorSet, 0, nullptr);
+    });
+    record("descriptor_binding_cost_allocate_update", { { "buffers", bufferCount }, { "rounds", rounds } }, allocateSeconds, "us");
+
+    // The first round fills the cache, every later one only hits it
+    double cachedSeconds = timeRounds([&](const Buffer& buffer) {
+        VkDescriptorSet descriptorSet = allocator.getSet(setLayouts[0], { buffer.buffer, 0, bufferSize });
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts[0], 0, 1, &descriptorSet, 0, nullptr);
+    });
+    const DescriptorAllocator::Stats& stats = allocator.getStats();
+    record("descriptor_binding_cost_cached", { { "buffers", bufferCount }, { "rounds", rounds },
+                                               { "allocations", static_cast<double>(stats.allocations) },
+                                               { "cache_hits", static_cast<double>(stats.cacheHits) } },
+           cachedSeconds, "us");
+
+    if (push)
+    {
+        double pushSeconds = timeRounds([&](const Buffer& buffer) {
+            VkDescriptorBufferInfo descriptorBufferInfo = { buffer.buffer, 0, bufferSize };
+            VkWriteDescriptorSet writeDescriptorSet = {};
+            writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSet.dstBinding = 0;
+            writeDescriptorSet.descriptorCount = 1;
+            writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
+            m_app.m_cmdPushDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayouts[1], 0, 1, &writeDescriptorSet);
+        });
+        record("descriptor_binding_cost_push", { { "buffers", bufferCount }, { "rounds", rounds } }, pushSeconds, "us");
+    }
+
+    allocator.destroy();
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        if (pipelineLayouts[i] != VK_NULL_HANDLE)
+            vkDestroyPipelineLayout(device, pipelineLayouts[i], nullptr);
+        if (setLayouts[i] != VK_NULL_HANDLE)
+            vkDestroyDescriptorSetLayout(device, setLayouts[i], nullptr);
+    }
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    for (Buffer& buffer : buffers)
+        m_app.destroyBuffer(buffer);
+}
+
+void Benchmark::primitivesThroughput()
+{
+    // Host to host, so the uploads and downloads of every call are included. The first call of
+    // each size builds the graph and is checked against the CPU.
+    uint32_t iterations = m_quick ? 3 : 10;
+    std::vector<uint32_t> sizes = { 1u << 16, 1u << 20 };
+    if (!m_quick)
+    {
+        sizes.push_back(1u << 22);
+        sizes.push_back(1u << 24);
+    }
+
+    Primitives primitives(m_app);
+    std::vector<bool> modes = { false };
+    if (primitives.isSubgroupSupported())
+        modes.push_back(true);
+
+    for (uint32_t elementCount : sizes)
+    {
+        std::vector<uint32_t> values(elementCount), flags(elementCount), result(elementCount), keys(elementCount), sortValues(elementCount);
+        uint32_t seed = 1;
+        for (uint32_t i = 0; i < elementCount; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            values[i] = seed >> 24;
+            flags[i] = (seed >> 8) & 1;
+        }
+
+        std::vector<uint32_t> expectedExclusive(elementCount), expectedInclusive(elementCount), expectedKept, expectedOrder(elementCount);
+        uint32_t expectedSum = std::accumulate(values.begin(), values.end(), 0u);
+        std::exclusive_scan(values.begin(), values.end(), expectedExclusive.begin(), 0u);
+        std::inclusive_scan(values.begin(), values.end(), expectedInclusive.begin());
+        for (uint32_t i = 0; i < elementCount; ++i)
+        {
+            if (flags[i] != 0)
+                expectedKept.push_back(values[i]);
+        }
+        std::iota(expectedOrder.begin(), expectedOrder.end(), 0u);
+        std::stable_sort(expectedOrder.begin(), expectedOrder.end(), [&](uint32_t a, uint32_t b) { return values[a] < values[b]; });
+
+        for (bool subgroups : modes)
+        {
+            primitives.setUseSubgroups(subgroups);
+            Params params = { { "elements", elementCount }, { "subgroups", subgroups ? 1 : 0 } };
+            auto timeOperation = [&](const std::function<void()>& prepare, const std::function<void()>& operation)
+            {
+                std::vector<double> samples;
+                for (uint32_t i = 0; i < iterations; ++i)
+                {
+                    prepare();
+                    auto start = std::chrono::high_resolution_clock::now();
+                    operation();
+                    samples.push_back(secondsSince(start));
+                }
+                return elementCount / median(samples) * 1e-6;
+            };
+
+            if (primitives.reduce(values.data(), elementCount) != expectedSum)
+                throw std::runtime_error("Reduce does not match the CPU reference");
+            record("primitive_reduce", params,
+                   timeOperation([] {}, [&] { primitives.reduce(values.data(), elementCount); }), "Melements/s");
+
+            primitives.exclusiveScan(values.data(), result.data(), elementCount);
+            if (result != expectedExclusive)
+                throw std::runtime_error("Exclusive scan does not match the CPU reference");
+            record("primitive_exclusive_scan", params,
+                   timeOperation([] {}, [&] { primitives.exclusiveScan(values.data(), result.data(), elementCount); }), "Melements/s");
+
+            primitives.inclusiveScan(values.data(), result.data(), elementCount);
+            if (result != expectedInclusive)
+                throw std::runtime_error("Inclusive scan does not match the CPU reference");
+            record("primitive_inclusive_scan", params,
+                   timeOperation([] {}, [&] { primitives.inclusiveScan(values.data(), result.data(), elementCount); }), "Melements/s");
+
+            uint32_t kept = primitives.compact(values.data(), flags.data(), result.data(), elementCount);
+            if (kept != expectedKept.size() || !std::equal(expectedKept.begin(), expectedKept.end(), result.begin()))
+                throw std::runtime_error("Compaction does not match the CPU reference");
+            record("primitive_compact", params,
+                   timeOperation([] {}, [&] { primitives.compact(values.data(), flags.data(), result.data(), elementCount); }), "Melements/s");
+
+            // Sorts in place, so every run starts from a fresh copy outside the timed part
+            auto resetSort = [&]
+            {
+                std::copy(values.begin(), values.end(), keys.begin());
+                std::iota(sortValues.begin(), sortValues.end(), 0u);
+            };
+            resetSort();
+            primitives.sortPairs(keys.data(), sortValues.data(), elementCount);
+            if (sortValues != expectedOrder)
+                throw std::runtime_error("Radix sort does not match the CPU reference");
+            record("primitive_sort_pairs", params,
+                   timeOperation(resetSort, [&] { primitives.sortPairs(keys.data(), sortValues.data(), elementCount); }), "Melements/s");
+        }
+    }
+}
+
+void Benchmark::packedStorageAdd()
+{
+    // The same kernel over 32-bit floats, 16-bit floats and 8-bit integers. It is bandwidth bound,
+    // so the time should follow the bytes per element.
+    uint32_t elementCount = m_quick ? 1 << 18 : 1 << 22;
+    uint32_t iterations = m_quick ? 5 : 20;
+    const Application::StorageFeatures& features = m_app.getStorageFeatures();
+    auto recordAdd = [&](uint32_t bits, double seconds)
+    {
+        record("packed_storage_add", { { "elements", elementCount }, { "element_bits", bits } },
+               elementCount / seconds * 1e-6, "Melements/s");
+    };
+
+    {
+        std::vector<float> a(elementCount, 1.5f), b(elementCount, 2.25f), c(elementCount);
+        double seconds = timePackedAdd(m_app, nullptr, a, b, c, iterations);
+        if (c.back() != 3.75f)
+            throw std::runtime_error("Packed add results do not match the CPU reference");
+        recordAdd(32, seconds);
+    }
+    if (features.storage16Bit)
+    {
+        std::vector<BufferLayout::Half> a(elementCount, BufferLayout::Half(1.5f)), b(elementCount, BufferLayout::Half(2.25f)),
+            c(elementCount);
+        double seconds = timePackedAdd(m_app, "ELEMENT_HALF", a, b, c, iterations);
+        if (static_cast<float>(c.back()) != 3.75f)
+            throw std::runtime_error("Packed add results do not match the CPU reference");
+        recordAdd(16, seconds);
+    }
+    if (features.storage8Bit)
+    {
+        std::vector<int8_t> a(elementCount, 100), b(elementCount, 56), c(elementCount);
+        double seconds = timePackedAdd(m_app, "ELEMENT_INT8", a, b, c, iterations);
+        if (c.back() != static_cast<int8_t>(156))
+            throw std::runtime_error("Packed add results do not match the CPU reference");
+        recordAdd(8, seconds);
+    }
+}
+
+void Benchmark::serverJobLatency()
+{
+#ifndef _WIN32
+    // A job sent to the resident server against what a process per job pays before its first submit
+    uint32_t iterations = m_quick ? 100 : 1000;
+    std::string socketPath = (std::filesystem::temp_directory_path() /
+                              ("vulkan_compute_benchmark_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".sock"))
+                                 .string();
+
+    {
+        ComputeServer server(m_app, socketPath);
+        std::string error, serverError;
+        std::thread serving([&]
+        {
+            try
+            {
+                server.run();
+            }
+            catch (const std::runtime_error& err)
+            {
+                serverError = err.what();
+            }
+        });
+
+        try
+        {
+            for (uint32_t elementCount : { ComputeBackend::maxSmallBatchSize, 1u << 16 })
+            {
+                ComputeClient client(socketPath, elementCount);
+                Calculation* calculations = client.data();
+                for (uint32_t i = 0; i < elementCount; ++i)
+                    calculations[i] = { 1.f, static_cast<float>(i % 1000), 0.f };
+                client.compute(elementCount);
+                if (calculations[elementCount - 1].res != 1.f + static_cast<float>((elementCount - 1) % 1000))
+                    throw std::runtime_error("Server results do not match the CPU reference");
+
+                std::vector<double> samples;
+                for (uint32_t i = 0; i < iterations; ++i)
+                {
+                    auto start = std::chrono::high_resolution_clock::now();
+                    client.compute(elementCount);
+                    samples.push_back(secondsSince(start));
+                }
+                record("server_job_latency", { { "elements", elementCount } }, median(samples) * 1e6, "us");
+            }
+        }
+        catch (const std::runtime_error& err)
+        {
+            error = err.what();
+        }
+
+        server.stop();
+        serving.join();
+        if (!serverError.empty())
+            throw std::runtime_error(serverError);
+        if (!error.empty())
+            throw std::runtime_error(error);
+    }
+
+    // Warm caches on disk, as for every process after the first
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        Application app;
+        app.setPhysicalDeviceIndex(m_app.m_physicalDeviceIndex);
+        app.setup();
+        app.shutdown();
+        record("setup_and_shutdown", {}, secondsSince(start) * 1e3, "ms");
+    }
+#endif
+}
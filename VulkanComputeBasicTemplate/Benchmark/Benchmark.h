@@ -0,0 +1,64 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Application.h"
+
+// Runs the dispatch, transfer and throughput benchmarks against one Application and
+// collects the results for machine-readable output
+class Benchmark
+{
+public:
+    Benchmark(Application& app, bool quick);
+
+    void runAll();
+    void writeJson(const std::string& path) const;
+
+private:
+    typedef std::vector<std::pair<std::string, double>> Params;
+
+    struct Result
+    {
+        std::string name;
+        Params params;
+        double value;
+        std::string unit;
+    };
+
+    void record(const std::string& name, const Params& params, double value, const std::string& unit);
+
+    // Takes the next ring slot away from computeBatchAsync, its recording is replaced
+    uint32_t acquireFrame();
+    // Records commands into the slot's command buffer, submits and waits. Returns the
+    // seconds from submit until the fence signals.
+    double submitAndWait(uint32_t slot, const std::function<void(VkCommandBuffer)>& recordCommands);
+    // Median seconds of computeBatchAsync plus waitBatch
+    double timeBatch(Calculation* calculations, uint32_t elementCount, uint32_t iterations);
+
+    void emptyDispatchLatency();
+    void submitToFenceLatency();
+    void smallBatchLatency();
+    void transferBandwidth();
+    void throughputByProblemSize();
+    void throughputByWorkgroupSize();
+    void allocationLatency();
+    void mappingLatency();
+    void asyncDepthThroughput();
+    void recordingCost();
+    void graphChainLatency();
+    void indirectChainLatency();
+    void pipelineStartupByThreads();
+    void ingestion();
+    void streamingThroughput();
+    void descriptorBindingCost();
+    void primitivesThroughput();
+    void packedStorageAdd();
+    void serverJobLatency();
+
+    Application& m_app;
+    bool m_quick;
+    std::vector<Result> m_results;
+};
@@ -0,0 +1,43 @@
+#include <stdexcept>
+#include <iostream>
+#include <cstring>
+
+#include "Benchmark.h"
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    std::string output = "benchmark_results.json";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            quick = true;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--quick] [--output results.json]" << std::endl;
+            return 1;
+        }
+    }
+
+    try
+    {
+        Application app;
+        Benchmark benchmark(app, quick);
+        benchmark.runAll();
+        benchmark.writeJson(output);
+        std::cerr << "Results written to " << output << std::endl;
+    }
+    catch (const std::runtime_error& err)
+    {
+        std::cerr << err.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,5 +1,10 @@
 #version 450
 
+// Specialization constants, set by Application::createComputePipeline
+layout(local_size_x_id = 0) in;
+// Elements handled by each invocation, strided by the total number of invocations in the dispatch
+layout(constant_id = 1) const uint ELEMENTS_PER_INVOCATION = 1;
+
 struct Calculation
 {
     float f1;
@@ -7,12 +12,22 @@ struct Calculation
     float res;
 };
 
-layout(std140, binding = 0) buffer buf
+layout(std430, binding = 0) buffer buf
 {
-    Calculation calc;
+    Calculation calcs[];
 };
 
 void main()
 {
-    calc.res = calc.f1 + calc.f2;
-}
\ No newline at end of file
+    // Large batches are dispatched as a 2D grid of workgroups, flatten it back into one index
+    uint invocationCount = gl_NumWorkGroups.x * gl_NumWorkGroups.y * gl_WorkGroupSize.x;
+    uint index = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+
+    for (uint i = 0; i < ELEMENTS_PER_INVOCATION; ++i, index += invocationCount)
+    {
+        if (index >= calcs.length())
+            return;
+
+        calcs[index].res = calcs[index].f1 + calcs[index].f2;
+    }
+}
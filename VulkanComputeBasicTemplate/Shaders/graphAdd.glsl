@@ -0,0 +1,17 @@
+#version 450
+
+// Element-wise stage of a ComputeGraph: c = a + b
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer A { float a[]; };
+layout(std430, binding = 1) readonly buffer B { float b[]; };
+layout(std430, binding = 2) buffer C { float c[]; };
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= c.length())
+        return;
+
+    c[index] = a[index] + b[index];
+}
@@ -0,0 +1,32 @@
+#version 450
+
+// Element-wise stage of a ComputeGraph over narrow storage types: c = a + b, added in 32 bits.
+// ELEMENT_HALF selects float16_t elements, ELEMENT_INT8 wrapping int8_t ones, float otherwise.
+#if defined(ELEMENT_HALF)
+#extension GL_EXT_shader_16bit_storage : require
+#define ELEMENT float16_t
+#define WIDE float
+#elif defined(ELEMENT_INT8)
+#extension GL_EXT_shader_8bit_storage : require
+#define ELEMENT int8_t
+#define WIDE int
+#else
+#define ELEMENT float
+#define WIDE float
+#endif
+
+layout(local_size_x = 256) in;
+
+// Tightly packed, must match BufferLayout::Element of the host type
+layout(std430, binding = 0) readonly buffer A { ELEMENT a[]; };
+layout(std430, binding = 1) readonly buffer B { ELEMENT b[]; };
+layout(std430, binding = 2) buffer C { ELEMENT c[]; };
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= c.length())
+        return;
+
+    c[index] = ELEMENT(WIDE(a[index]) + WIDE(b[index]));
+}
@@ -0,0 +1,19 @@
+#version 450
+
+// Turns the count of a filter stage into the grid of the indirect stage after it, and copies the
+// count out for the host
+layout(local_size_x = 1) in;
+
+layout(std430, binding = 0) buffer Args { uint groupCountX; uint groupCountY; uint groupCountZ; uint count; };
+layout(std430, binding = 1) writeonly buffer Count { uint countOut[]; };
+
+// Every device supports at least this many groups in x, the indirect stage loops over the rest
+const uint maxGroupCount = 65535;
+
+void main()
+{
+    groupCountX = min((count + 255) / 256, maxGroupCount);
+    groupCountY = 1;
+    groupCountZ = 1;
+    countOut[0] = count;
+}
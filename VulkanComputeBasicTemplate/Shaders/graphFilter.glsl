@@ -0,0 +1,19 @@
+#version 450
+
+// Filter stage of a ComputeGraph: appends the positive elements of a to b, in no particular order,
+// and counts them in the dispatch arguments
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer A { float a[]; };
+layout(std430, binding = 1) writeonly buffer B { float b[]; };
+// VkDispatchIndirectCommand followed by the element count
+layout(std430, binding = 2) buffer Args { uint groupCountX; uint groupCountY; uint groupCountZ; uint count; };
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= a.length() || !(a[index] > 0.0))
+        return;
+
+    b[atomicAdd(count, 1)] = a[index];
+}
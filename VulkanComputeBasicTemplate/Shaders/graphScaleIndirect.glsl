@@ -0,0 +1,16 @@
+#version 450
+
+// Indirect stage of a ComputeGraph: c = 2 * a over the first count elements, however many groups
+// the dispatch arguments launched
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer A { float a[]; };
+layout(std430, binding = 1) readonly buffer Args { uint groupCountX; uint groupCountY; uint groupCountZ; uint count; };
+layout(std430, binding = 2) buffer C { float c[]; };
+
+void main()
+{
+    uint stride = gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+    for (uint index = gl_GlobalInvocationID.x; index < count; index += stride)
+        c[index] = 2.0 * a[index];
+}
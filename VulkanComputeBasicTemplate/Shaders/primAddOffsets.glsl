@@ -0,0 +1,26 @@
+#version 450
+
+// Adds the scanned block totals back to a block scan of the Primitives library
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer BlockOffsets { uint blockOffsets[]; };
+layout(std430, binding = 1) buffer Result { uint result[]; };
+
+const uint itemsPerInvocation = 4;
+const uint blockSize = 1024;
+
+void main()
+{
+    uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint count = result.length();
+    if (block == 0 || block * blockSize >= count)
+        return;
+
+    uint offset = blockOffsets[block];
+    for (uint i = 0; i < itemsPerInvocation; ++i)
+    {
+        uint index = block * blockSize + i * gl_WorkGroupSize.x + gl_LocalInvocationIndex;
+        if (index < count)
+            result[index] += offset;
+    }
+}
@@ -0,0 +1,35 @@
+#version 450
+
+// Stream compaction of the Primitives library: scatters the flagged values to the positions the
+// exclusive scan of the flags computed, which keeps them in order
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer Values { uint values[]; };
+layout(std430, binding = 1) readonly buffer Flags { uint flags[]; };
+layout(std430, binding = 2) readonly buffer Positions { uint positions[]; };
+layout(std430, binding = 3) writeonly buffer Result { uint result[]; };
+layout(std430, binding = 4) writeonly buffer Kept { uint keptCount; };
+
+const uint itemsPerInvocation = 4;
+const uint blockSize = 1024;
+
+void main()
+{
+    uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint count = values.length();
+    if (block * blockSize >= count)
+        return;
+
+    for (uint i = 0; i < itemsPerInvocation; ++i)
+    {
+        uint index = block * blockSize + i * gl_WorkGroupSize.x + gl_LocalInvocationIndex;
+        if (index >= count)
+            break;
+
+        bool keep = flags[index] != 0;
+        if (keep)
+            result[positions[index]] = values[index];
+        if (index == count - 1)
+            keptCount = positions[index] + uint(keep);
+    }
+}
@@ -0,0 +1,145 @@
+#version 450
+#ifdef SUBGROUPS
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+// First half of a radix sort pass of the Primitives library. Every workgroup sorts its 1024 keys by
+// the 4-bit digit at shift with four stable 1-bit splits in shared memory, then counts the digits.
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer Keys { uint keys[]; };
+layout(std430, binding = 1) readonly buffer Values { uint values[]; };
+layout(std430, binding = 2) writeonly buffer LocalKeys { uint localKeys[]; };
+layout(std430, binding = 3) writeonly buffer LocalValues { uint localValues[]; };
+// Digit-major, the count of digit d in block b is at d * blockCount + b. The exclusive scan of it
+// is where each block's digits start in the output.
+layout(std430, binding = 4) writeonly buffer Histogram { uint histogram[]; };
+layout(std430, binding = 5) readonly buffer Params { uint shift; };
+
+const uint itemsPerInvocation = 4;
+const uint blockSize = 1024;
+const uint radixBits = 4;
+const uint radix = 1 << radixBits;
+
+shared uint sharedKeys[blockSize];
+shared uint sharedValues[blockSize];
+shared uint digitCounts[radix];
+
+#ifdef SUBGROUPS
+// The host enables subgroups only at 16 or more invocations each, so there are at most 16
+shared uint subgroupSums[16];
+shared uint workgroupSum;
+
+uint workgroupExclusiveAdd(uint value, out uint total)
+{
+    uint inclusive = subgroupInclusiveAdd(value);
+    uint subgroupSum = subgroupAdd(value);
+    if (subgroupElect())
+        subgroupSums[gl_SubgroupID] = subgroupSum;
+    barrier();
+
+    // The first subgroup scans the subgroup sums
+    if (gl_SubgroupID == 0)
+    {
+        uint sum = gl_SubgroupInvocationID < gl_NumSubgroups ? subgroupSums[gl_SubgroupInvocationID] : 0;
+        uint prefix = subgroupExclusiveAdd(sum);
+        if (gl_SubgroupInvocationID < gl_NumSubgroups)
+            subgroupSums[gl_SubgroupInvocationID] = prefix;
+        if (gl_SubgroupInvocationID == gl_NumSubgroups - 1)
+            workgroupSum = prefix + sum;
+    }
+    barrier();
+
+    total = workgroupSum;
+    uint result = subgroupSums[gl_SubgroupID] + inclusive - value;
+    barrier();
+    return result;
+}
+#else
+shared uint scanBuffer[gl_WorkGroupSize.x];
+
+// Hillis-Steele scan in shared memory
+uint workgroupExclusiveAdd(uint value, out uint total)
+{
+    uint index = gl_LocalInvocationIndex;
+    scanBuffer[index] = value;
+    barrier();
+    for (uint offset = 1; offset < gl_WorkGroupSize.x; offset <<= 1)
+    {
+        uint add = index >= offset ? scanBuffer[index - offset] : 0;
+        barrier();
+        scanBuffer[index] += add;
+        barrier();
+    }
+
+    total = scanBuffer[gl_WorkGroupSize.x - 1];
+    uint result = scanBuffer[index] - value;
+    barrier();
+    return result;
+}
+#endif
+
+void main()
+{
+    uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint count = keys.length();
+    uint blockCount = (count + blockSize - 1) / blockSize;
+    if (block >= blockCount)
+        return;
+
+    uint blockStart = block * blockSize;
+    uint first = gl_LocalInvocationIndex * itemsPerInvocation;
+    uint itemKeys[itemsPerInvocation];
+    uint itemValues[itemsPerInvocation];
+    for (uint i = 0; i < itemsPerInvocation; ++i)
+    {
+        // Elements past the end have every bit set, so they stay behind all others of the block
+        uint index = blockStart + first + i;
+        itemKeys[i] = index < count ? keys[index] : 0xffffffffu;
+        itemValues[i] = index < count ? values[index] : 0;
+    }
+    if (gl_LocalInvocationIndex < radix)
+        digitCounts[gl_LocalInvocationIndex] = 0;
+
+    for (uint bit = shift; bit < shift + radixBits; ++bit)
+    {
+        uint zeros = 0;
+        for (uint i = 0; i < itemsPerInvocation; ++i)
+            zeros += 1 - ((itemKeys[i] >> bit) & 1);
+
+        // Zeros move to the front and ones behind them, both keep their order
+        uint totalZeros;
+        uint zerosBefore = workgroupExclusiveAdd(zeros, totalZeros);
+        for (uint i = 0; i < itemsPerInvocation; ++i)
+        {
+            uint one = (itemKeys[i] >> bit) & 1;
+            uint target = one == 0 ? zerosBefore : totalZeros + first + i - zerosBefore;
+            zerosBefore += 1 - one;
+            sharedKeys[target] = itemKeys[i];
+            sharedValues[target] = itemValues[i];
+        }
+        barrier();
+
+        for (uint i = 0; i < itemsPerInvocation; ++i)
+        {
+            itemKeys[i] = sharedKeys[first + i];
+            itemValues[i] = sharedValues[first + i];
+        }
+        barrier();
+    }
+
+    // The elements past the end are now the last ones of the block
+    for (uint i = 0; i < itemsPerInvocation; ++i)
+    {
+        uint index = blockStart + first + i;
+        if (index >= count)
+            break;
+        atomicAdd(digitCounts[(itemKeys[i] >> shift) & (radix - 1)], 1);
+        localKeys[index] = itemKeys[i];
+        localValues[index] = itemValues[i];
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex < radix)
+        histogram[gl_LocalInvocationIndex * blockCount + block] = digitCounts[gl_LocalInvocationIndex];
+}
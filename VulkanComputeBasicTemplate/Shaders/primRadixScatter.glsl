@@ -0,0 +1,54 @@
+#version 450
+
+// Second half of a radix sort pass of the Primitives library. Moves every element of a locally
+// sorted block to its digit's start in the output plus its rank among the block's equal digits.
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer LocalKeys { uint localKeys[]; };
+layout(std430, binding = 1) readonly buffer LocalValues { uint localValues[]; };
+layout(std430, binding = 2) readonly buffer Histogram { uint histogram[]; };
+layout(std430, binding = 3) readonly buffer DigitOffsets { uint digitOffsets[]; };
+layout(std430, binding = 4) writeonly buffer OutKeys { uint outKeys[]; };
+layout(std430, binding = 5) writeonly buffer OutValues { uint outValues[]; };
+layout(std430, binding = 6) readonly buffer Params { uint shift; };
+
+const uint itemsPerInvocation = 4;
+const uint blockSize = 1024;
+const uint radix = 16;
+
+// Where each digit starts inside the block
+shared uint digitStart[radix];
+
+void main()
+{
+    uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint count = localKeys.length();
+    uint blockCount = (count + blockSize - 1) / blockSize;
+    if (block >= blockCount)
+        return;
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        uint sum = 0;
+        for (uint digit = 0; digit < radix; ++digit)
+        {
+            digitStart[digit] = sum;
+            sum += histogram[digit * blockCount + block];
+        }
+    }
+    barrier();
+
+    for (uint i = 0; i < itemsPerInvocation; ++i)
+    {
+        uint local = i * gl_WorkGroupSize.x + gl_LocalInvocationIndex;
+        uint index = block * blockSize + local;
+        if (index >= count)
+            break;
+
+        uint key = localKeys[index];
+        uint digit = (key >> shift) & (radix - 1);
+        uint target = digitOffsets[digit * blockCount + block] + local - digitStart[digit];
+        outKeys[target] = key;
+        outValues[target] = localValues[index];
+    }
+}
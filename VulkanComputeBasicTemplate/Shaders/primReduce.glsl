@@ -0,0 +1,70 @@
+#version 450
+#ifdef SUBGROUPS
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+// Reduction of the Primitives library. Every workgroup sums 1024 elements into one partial sum,
+// the partial sums are reduced again until one is left.
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer Values { uint values[]; };
+layout(std430, binding = 1) writeonly buffer Partials { uint partials[]; };
+
+const uint itemsPerInvocation = 4;
+const uint blockSize = 1024;
+
+#ifdef SUBGROUPS
+// The host enables subgroups only at 16 or more invocations each, so there are at most 16
+shared uint subgroupSums[16];
+
+uint workgroupAdd(uint value)
+{
+    uint sum = subgroupAdd(value);
+    if (subgroupElect())
+        subgroupSums[gl_SubgroupID] = sum;
+    barrier();
+
+    uint total = 0;
+    for (uint i = 0; i < gl_NumSubgroups; ++i)
+        total += subgroupSums[i];
+    return total;
+}
+#else
+shared uint reduceBuffer[gl_WorkGroupSize.x];
+
+// Tree reduction in shared memory
+uint workgroupAdd(uint value)
+{
+    uint index = gl_LocalInvocationIndex;
+    reduceBuffer[index] = value;
+    barrier();
+    for (uint stride = gl_WorkGroupSize.x / 2; stride > 0; stride >>= 1)
+    {
+        if (index < stride)
+            reduceBuffer[index] += reduceBuffer[index + stride];
+        barrier();
+    }
+    return reduceBuffer[0];
+}
+#endif
+
+void main()
+{
+    uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint count = values.length();
+    if (block * blockSize >= count)
+        return;
+
+    // Neighbouring invocations read neighbouring elements, the order does not matter for a sum
+    uint sum = 0;
+    for (uint i = 0; i < itemsPerInvocation; ++i)
+    {
+        uint index = block * blockSize + i * gl_WorkGroupSize.x + gl_LocalInvocationIndex;
+        if (index < count)
+            sum += values[index];
+    }
+
+    uint total = workgroupAdd(sum);
+    if (gl_LocalInvocationIndex == 0)
+        partials[block] = total;
+}
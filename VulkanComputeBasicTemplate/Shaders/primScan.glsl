@@ -0,0 +1,103 @@
+#version 450
+#ifdef SUBGROUPS
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+// Block scan of the Primitives library. Every workgroup scans 1024 elements, 4 per invocation, and
+// writes the block total to blockSums. Later levels scan the totals and add them back.
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer Values { uint values[]; };
+layout(std430, binding = 1) writeonly buffer Result { uint result[]; };
+layout(std430, binding = 2) writeonly buffer BlockSums { uint blockSums[]; };
+// countNonZero scans (value != 0 ? 1 : 0) instead of the values, for compaction
+layout(std430, binding = 3) readonly buffer Params { uint inclusive; uint countNonZero; };
+
+const uint itemsPerInvocation = 4;
+const uint blockSize = 1024;
+
+#ifdef SUBGROUPS
+// The host enables subgroups only at 16 or more invocations each, so there are at most 16
+shared uint subgroupSums[16];
+shared uint workgroupSum;
+
+uint workgroupExclusiveAdd(uint value, out uint total)
+{
+    uint inclusive = subgroupInclusiveAdd(value);
+    uint subgroupSum = subgroupAdd(value);
+    if (subgroupElect())
+        subgroupSums[gl_SubgroupID] = subgroupSum;
+    barrier();
+
+    // The first subgroup scans the subgroup sums
+    if (gl_SubgroupID == 0)
+    {
+        uint sum = gl_SubgroupInvocationID < gl_NumSubgroups ? subgroupSums[gl_SubgroupInvocationID] : 0;
+        uint prefix = subgroupExclusiveAdd(sum);
+        if (gl_SubgroupInvocationID < gl_NumSubgroups)
+            subgroupSums[gl_SubgroupInvocationID] = prefix;
+        if (gl_SubgroupInvocationID == gl_NumSubgroups - 1)
+            workgroupSum = prefix + sum;
+    }
+    barrier();
+
+    total = workgroupSum;
+    uint result = subgroupSums[gl_SubgroupID] + inclusive - value;
+    barrier();
+    return result;
+}
+#else
+shared uint scanBuffer[gl_WorkGroupSize.x];
+
+// Hillis-Steele scan in shared memory
+uint workgroupExclusiveAdd(uint value, out uint total)
+{
+    uint index = gl_LocalInvocationIndex;
+    scanBuffer[index] = value;
+    barrier();
+    for (uint offset = 1; offset < gl_WorkGroupSize.x; offset <<= 1)
+    {
+        uint add = index >= offset ? scanBuffer[index - offset] : 0;
+        barrier();
+        scanBuffer[index] += add;
+        barrier();
+    }
+
+    total = scanBuffer[gl_WorkGroupSize.x - 1];
+    uint result = scanBuffer[index] - value;
+    barrier();
+    return result;
+}
+#endif
+
+void main()
+{
+    // Grids wider than 65535 groups spill into y
+    uint block = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint count = values.length();
+    if (block * blockSize >= count)
+        return;
+
+    // Consecutive elements per invocation, so the scan order is the element order
+    uint first = block * blockSize + gl_LocalInvocationIndex * itemsPerInvocation;
+    uint items[itemsPerInvocation];
+    uint sum = 0;
+    for (uint i = 0; i < itemsPerInvocation; ++i)
+    {
+        uint value = first + i < count ? values[first + i] : 0;
+        items[i] = countNonZero != 0 ? uint(value != 0) : value;
+        sum += items[i];
+    }
+
+    uint total;
+    uint prefix = workgroupExclusiveAdd(sum, total);
+    for (uint i = 0; i < itemsPerInvocation && first + i < count; ++i)
+    {
+        uint next = prefix + items[i];
+        result[first + i] = inclusive != 0 ? next : prefix;
+        prefix = next;
+    }
+
+    if (gl_LocalInvocationIndex == 0)
+        blockSums[block] = total;
+}
@@ -0,0 +1,25 @@
+#version 450
+
+// Small batches passed entirely through push constants, see Application::computeSmallBatch
+layout(local_size_x = 16) in;
+
+// Must match Application::SmallBatchConstants, 128 bytes is the guaranteed maxPushConstantsSize
+layout(push_constant) uniform SmallBatchConstants
+{
+    uint count;
+    vec2 operands[15];
+} batch;
+
+layout(std430, binding = 0) buffer Results
+{
+    float results[];
+};
+
+void main()
+{
+    uint index = gl_LocalInvocationID.x;
+    if (index >= batch.count)
+        return;
+
+    results[index] = batch.operands[index].x + batch.operands[index].y;
+}
@@ -2,84 +2,513 @@
 
 #include <stdexcept>
 #include <iostream>
-
+#include <cstring>
+#include <cstdio>
+#include <limits>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+#include "PipelineBuilder.h"
 #include "ShaderLoader.h"
+#include "ThreadPool.h"
 
 #define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
 
-struct Calculation
-{
-    float f1, f2, res;
-};
-
-void Application::Run()
-{
-    setup();
-    runCompute();
-}
-
 void Application::setup()
 {
+    PROFILE_SCOPE("setup");
+
     createInstance();
     findPhysicalDevice();
     createDevice();
-    createDataBufferAndDescriptorSet();
+    m_shaderModuleCache.init(m_device);
+    createMemoryArena();
+    createDescriptorSetLayoutAndPool();
+    createPipelineCache();
+    // A known device only builds its tuned pipeline, otherwise the default is built and then tuned
+    bool tuned = loadKernelTuning();
     createComputePipeline();
-    createCommandBuffer();
+    createFrames();
+    createSmallBatchResources();
+    if (!tuned && m_autotune)
+        autotuneKernel();
+}
+
+void Application::shutdown()
+{
+    // Also undoes a setup that threw part way, only what was created is destroyed
+    if (m_device != VK_NULL_HANDLE)
+    {
+        for (Frame& frame : m_frames)
+            retireFrame(frame);
+
+        vkDeviceWaitIdle(m_device);
+        m_pipelineCache.save();
+        m_pipelineCache.destroy();
+
+        // Everything setup created, in reverse. ComputeGraphs on this device must be destroyed first.
+        destroyComputePipeline();
+        m_shaderModules.clear();
+        m_smallBatchRing.destroy();
+        m_descriptorAllocator.releaseBuffer(m_smallBatchResults.buffer);
+        destroyBuffer(m_smallBatchResults);
+        m_smallBatchDescriptorSet = VK_NULL_HANDLE;
+        destroyFrames();
+        m_hostMemoryImporter.destroy();
+        m_descriptorAllocator.destroy();
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+        m_descriptorSetLayout = VK_NULL_HANDLE;
+        m_memoryArena.destroy();
+        m_shaderModuleCache.destroy();
+        vkDestroyDevice(m_device, nullptr);
+        m_device = VK_NULL_HANDLE;
+    }
+
+    if (m_instance != VK_NULL_HANDLE)
+    {
+        if (m_enableValidationLayers)
+        {
+            auto vkDestroyDebugReportCallbackEXT = (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(m_instance, "vkDestroyDebugReportCallbackEXT");
+            if (vkDestroyDebugReportCallbackEXT != nullptr)
+                vkDestroyDebugReportCallbackEXT(m_instance, m_debugReportCallback, nullptr);
+        }
+        vkDestroyInstance(m_instance, nullptr);
+        m_instance = VK_NULL_HANDLE;
+    }
+
+    const IngestionStats& stats = m_ingestionStats;
+    if (stats.stagedBatches > 0)
+        std::cout << "Staged ingestion: " << stats.stagedBatches << " batches, " << stats.copiedBytes / (1024.0 * 1024.0)
+                  << " MiB copied in " << stats.copySeconds * 1000.0 << " ms" << std::endl;
+    if (stats.importedBatches > 0)
+        std::cout << "Imported ingestion: " << stats.importedBatches << " batches, " << stats.importedBytes / (1024.0 * 1024.0)
+                  << " MiB in place, 0 bytes copied, " << stats.importSeconds * 1000.0 << " ms importing" << std::endl;
+
+#ifdef VK_PROFILE
+    Profiler::get().writeChromeTrace("trace.json");
+    Profiler::get().printSummary();
+#endif
+}
+
+BatchHandle Application::computeBatchAsync(Calculation* calculations, uint32_t elementCount)
+{
+    PROFILE_SCOPE("computeBatchAsync");
+
+    BatchHandle batch;
+    if (elementCount == 0)
+        return batch;
+
+    // Blocks only if every frame is still in flight
+    uint32_t slot = m_submissionRing.acquire();
+    Frame& frame = m_frames[slot];
+    retireFrame(frame);
+
+    VkDeviceSize dataSize = sizeof(Calculation) * elementCount;
+
+    // Registered host memory is bound directly, the descriptor offset must still meet the device's alignment
+    const HostMemoryImporter::Region* region = m_hostMemoryImporter.find(calculations, dataSize);
+    VkDeviceSize importOffset = region ? reinterpret_cast<char*>(calculations) - region->pointer : 0;
+    if (region && importOffset % m_deviceProperties.limits.minStorageBufferOffsetAlignment == 0 &&
+        dataSize <= m_deviceProperties.limits.maxStorageBufferRange)
+    {
+        bindDataBuffer(frame, region->buffer, importOffset, elementCount);
+        frame.importedBuffer = region->buffer;
+
+        ++m_ingestionStats.importedBatches;
+        m_ingestionStats.importedBytes += dataSize;
+    }
+    else
+    {
+        reserveDataBuffer(frame, elementCount);
+
+        // Device-local data is moved through the staging buffer by the copies recorded in recordCompute or recordTransfers
+        auto start = std::chrono::high_resolution_clock::now();
+        Buffer& hostBuffer = frame.dataBuffer.hostVisible ? frame.dataBuffer : frame.stagingBuffer;
+        memcpy(mappedSpan<Calculation>(hostBuffer).data(), calculations, dataSize);
+        m_memoryArena.flush(hostBuffer.allocation, 0, dataSize);
+
+        ++m_ingestionStats.stagedBatches;
+        m_ingestionStats.copiedBytes += dataSize;
+        m_ingestionStats.copySeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    frame.elementCount = elementCount;
+    if (!isRecordingValid(frame))
+        recordCompute(frame, slot);
+
+#ifdef VK_PROFILE
+    frame.submitTimeNs = Profiler::get().now();
+#endif
+    frame.submit = usesTransferQueue(frame) ? m_submissionRing.submitWithTransfers(slot) : m_submissionRing.submit(slot);
+    frame.output = calculations;
+
+    batch.submit = frame.submit;
+    return batch;
 }
 
-void Application::runCompute()
+bool Application::isBatchComplete(const BatchHandle& batch) const
 {
+    const Frame& frame = m_frames[batch.submit.slot];
+    if (frame.output == nullptr || frame.submit.id != batch.submit.id)
+        return true;
+
+    return m_submissionRing.isComplete(batch.submit);
+}
+
+void Application::waitBatch(const BatchHandle& batch)
+{
+    PROFILE_SCOPE("waitBatch");
+
+    Frame& frame = m_frames[batch.submit.slot];
+
+    // Otherwise the frame was already retired when it was reused
+    if (frame.output != nullptr && frame.submit.id == batch.submit.id)
+        retireFrame(frame);
+}
+
+void Application::retireFrame(Frame& frame)
+{
+    if (frame.output == nullptr)
+        return;
+
+    m_submissionRing.wait(frame.submit);
+
+#ifdef VK_PROFILE
+    if (m_timestampQueryPool != VK_NULL_HANDLE)
+    {
+        uint64_t timestamps[2];
+        uint32_t frameIndex = static_cast<uint32_t>(&frame - m_frames.data());
+        CHECK_VK_RESULT(vkGetQueryPoolResults(m_device, m_timestampQueryPool, frameIndex * 2, 2, sizeof(timestamps), timestamps,
+                                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT),
+                        "Failed to read timestamp queries");
+
+        uint64_t mask = m_timestampValidBits >= 64 ? ~0ULL : (1ULL << m_timestampValidBits) - 1;
+        uint64_t ticks = ((timestamps[1] & mask) - (timestamps[0] & mask)) & mask;
+
+        // GPU and host clocks are not calibrated, the range is anchored at the host submit time
+        Profiler::get().recordGpu("dispatch", frame.submitTimeNs,
+                                  (uint64_t)((double)ticks * m_deviceProperties.limits.timestampPeriod));
+    }
+#endif
+
+    // Imported memory is coherent and already holds the results
+    if (frame.importedBuffer == VK_NULL_HANDLE)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        VkDeviceSize dataSize = sizeof(Calculation) * frame.elementCount;
+        Buffer& hostBuffer = frame.dataBuffer.hostVisible ? frame.dataBuffer : frame.stagingBuffer;
+        m_memoryArena.invalidate(hostBuffer.allocation, 0, dataSize);
+        memcpy(frame.output, mappedSpan<Calculation>(hostBuffer).data(), dataSize);
+
+        m_ingestionStats.copiedBytes += dataSize;
+        m_ingestionStats.copySeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    frame.output = nullptr;
+}
+
+bool Application::registerHostMemory(void* pointer, size_t size)
+{
+    PROFILE_SCOPE("registerHostMemory");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    bool imported = m_hostMemoryImporter.import(pointer, size);
+    m_ingestionStats.importSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return imported;
+}
+
+void Application::unregisterHostMemory(void* pointer)
+{
+    const HostMemoryImporter::Region* region = m_hostMemoryImporter.find(pointer, 0);
+    if (region == nullptr)
+        return;
+
+    // Recordings and descriptor sets that reference the buffer are rebuilt on the frame's next batch
+    for (Frame& frame : m_frames)
+    {
+        if (frame.boundBuffer != region->buffer)
+            continue;
+        retireFrame(frame);
+        frame.importedBuffer = VK_NULL_HANDLE;
+    }
+    releaseDescriptors(region->buffer);
+
+    m_hostMemoryImporter.release(pointer);
+}
+
+void Application::setFramesInFlight(uint32_t depth)
+{
+    if (depth == 0 || depth > m_maxFramesInFlight)
+        throw std::runtime_error("Unsupported number of frames in flight");
+
+    if (!m_frames.empty())
+    {
+        for (Frame& frame : m_frames)
+            retireFrame(frame);
+        destroyFrames();
+        m_framesInFlight = depth;
+        createFrames();
+    }
+    else
+    {
+        m_framesInFlight = depth;
+    }
+}
+
+bool Application::isRecordingValid(const Frame& frame) const
+{
+    // Buffer and descriptor changes clear commandsRecorded in reserveDataBuffer
+    return m_reuseRecordedCommands &&
+           frame.commandsRecorded &&
+           frame.recordedPipelineGeneration == m_pipelineGeneration &&
+           frame.recordedElementCount == frame.elementCount;
+}
+
+static VkBufferMemoryBarrier bufferBarrier(VkBuffer buffer, VkDeviceSize size, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+                                           uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                           uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED)
+{
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+    barrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+    barrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = size;
+    return barrier;
+}
+
+bool Application::usesTransferQueue(const Frame& frame) const
+{
+    return frame.importedBuffer == VK_NULL_HANDLE && !frame.dataBuffer.hostVisible && m_submissionRing.hasTransferQueue();
+}
+
+void Application::recordCompute(Frame& frame, uint32_t slot)
+{
+    uint32_t elementCount = frame.elementCount;
+    VkCommandBuffer commandBuffer = m_submissionRing.getCommandBuffer(slot);
+
+    uint32_t groupCountX, groupCountY;
+    getDispatchSize(elementCount, groupCountX, groupCountY);
+
+    // No ONE_TIME_SUBMIT, the recording is resubmitted as long as isRecordingValid holds.
+    // Beginning implicitly resets the buffer since the ring's pool allows individual resets.
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-    CHECK_VK_RESULT(vkBeginCommandBuffer(m_commandBuffer, &beginInfo),
+    VkDeviceSize dataSize = sizeof(Calculation) * elementCount;
+    bool imported = frame.importedBuffer != VK_NULL_HANDLE;
+    bool useStaging = !imported && !frame.dataBuffer.hostVisible;
+    bool useTransferQueue = usesTransferQueue(frame);
+
+    if (useTransferQueue)
+        recordTransfers(frame, m_submissionRing.getUploadCommandBuffer(slot), m_submissionRing.getDownloadCommandBuffer(slot));
+
+    CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
+                    "Failed to begin command buffer");
+    {
+        VkBufferCopy copyRegion = {};
+        copyRegion.size = dataSize;
+
+        if (useTransferQueue)
+        {
+            // Acquire half of the ownership transfer released by the upload, the semaphore wait
+            // happens at the compute stage so the barrier chains from there
+            VkBufferMemoryBarrier barrier = bufferBarrier(frame.dataBuffer.buffer, dataSize, 0,
+                                                          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                                          m_transferQueueFamilyIndex, m_computeQueueFamilyIndex);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+        else if (useStaging)
+        {
+            vkCmdCopyBuffer(commandBuffer, frame.stagingBuffer.buffer, frame.dataBuffer.buffer, 1, &copyRegion);
+
+            VkBufferMemoryBarrier barrier = bufferBarrier(frame.dataBuffer.buffer, dataSize, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+
+#ifdef VK_PROFILE
+        uint32_t frameIndex = static_cast<uint32_t>(&frame - m_frames.data());
+        if (m_timestampQueryPool != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(commandBuffer, m_timestampQueryPool, frameIndex * 2, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampQueryPool, frameIndex * 2);
+        }
+#endif
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        cmdBindDataBuffer(commandBuffer, frame);
+
+        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+#ifdef VK_PROFILE
+        if (m_timestampQueryPool != VK_NULL_HANDLE)
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, m_timestampQueryPool, frameIndex * 2 + 1);
+#endif
+
+        if (useTransferQueue)
+        {
+            // Release to the transfer family, the download acquires it after waiting on the semaphore
+            VkBufferMemoryBarrier barrier = bufferBarrier(frame.dataBuffer.buffer, dataSize, VK_ACCESS_SHADER_WRITE_BIT, 0,
+                                                          m_computeQueueFamilyIndex, m_transferQueueFamilyIndex);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+        else if (useStaging)
+        {
+            VkBufferMemoryBarrier barrier = bufferBarrier(frame.dataBuffer.buffer, dataSize, VK_ACCESS_SHADER_WRITE_BIT,
+                                                          VK_ACCESS_TRANSFER_READ_BIT);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+
+            vkCmdCopyBuffer(commandBuffer, frame.dataBuffer.buffer, frame.stagingBuffer.buffer, 1, &copyRegion);
+
+            barrier = bufferBarrier(frame.stagingBuffer.buffer, dataSize, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+        else
+        {
+            // An imported batch may start at an offset into its buffer
+            VkBufferMemoryBarrier barrier = bufferBarrier(frame.boundBuffer, imported ? VK_WHOLE_SIZE : dataSize, VK_ACCESS_SHADER_WRITE_BIT,
+                                                          VK_ACCESS_HOST_READ_BIT);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                 0, nullptr, 1, &barrier, 0, nullptr);
+        }
+    }
+    CHECK_VK_RESULT(vkEndCommandBuffer(commandBuffer),
+                    "Failed to end command buffer");
+
+    frame.commandsRecorded = true;
+    frame.recordedPipelineGeneration = m_pipelineGeneration;
+    frame.recordedElementCount = elementCount;
+}
+
+void Application::computeSmallBatch(Calculation* calculations, uint32_t elementCount)
+{
+    PROFILE_SCOPE("computeSmallBatch");
+
+    if (elementCount > maxSmallBatchSize)
+    {
+        waitBatch(computeBatchAsync(calculations, elementCount));
+        return;
+    }
+    if (elementCount == 0)
+        return;
+
+    SmallBatchConstants constants = {};
+    constants.count = elementCount;
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        constants.operands[i][0] = calculations[i].f1;
+        constants.operands[i][1] = calculations[i].f2;
+    }
+
+    // Push constants live in the command buffer, so every call records again. That is a handful of
+    // commands, cheaper than the memcpy, flush and copy of the buffer path.
+    uint32_t slot = m_smallBatchRing.acquire();
+    VkCommandBuffer commandBuffer = m_smallBatchRing.getCommandBuffer(slot);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
                     "Failed to begin command buffer");
     {
-        vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
-        vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_smallBatchPipeline);
+        if (m_cmdPushDescriptorSet)
+        {
+            VkDescriptorBufferInfo descriptorBufferInfo = { m_smallBatchResults.buffer, 0, VK_WHOLE_SIZE };
+            VkWriteDescriptorSet writeDescriptorSet = {};
+            writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSet.dstBinding = 0;
+            writeDescriptorSet.descriptorCount = 1;
+            writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
+            m_cmdPushDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &writeDescriptorSet);
+        }
+        else
+        {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_smallBatchDescriptorSet, 0, nullptr);
+        }
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
 
-        vkCmdDispatch(m_commandBuffer, 1, 1, 1);
+        VkBufferMemoryBarrier barrier = bufferBarrier(m_smallBatchResults.buffer, VK_WHOLE_SIZE, VK_ACCESS_SHADER_WRITE_BIT,
+                                                      VK_ACCESS_HOST_READ_BIT);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             0, nullptr, 1, &barrier, 0, nullptr);
     }
-    CHECK_VK_RESULT(vkEndCommandBuffer(m_commandBuffer),
+    CHECK_VK_RESULT(vkEndCommandBuffer(commandBuffer),
                     "Failed to end command buffer");
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &m_commandBuffer;
+    m_smallBatchRing.wait(m_smallBatchRing.submit(slot));
 
-    VkFence waitFence;
-    VkFenceCreateInfo fenceCreateInfo = {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceCreateInfo.flags = 0;
-    CHECK_VK_RESULT(vkCreateFence(m_device, &fenceCreateInfo, nullptr, &waitFence),
-                    "Failed to create fence");
+    m_memoryArena.invalidate(m_smallBatchResults.allocation, 0, sizeof(float) * elementCount);
+    MappedSpan<float> results = mappedSpan<float>(m_smallBatchResults);
+    for (uint32_t i = 0; i < elementCount; ++i)
+        calculations[i].res = results[i];
+}
 
-    CHECK_VK_RESULT(vkQueueSubmit(m_computeQueue, 1, &submitInfo, waitFence),
-                    "Failed to submit queue");
+void Application::getDispatchSize(uint32_t elementCount, uint32_t& groupCountX, uint32_t& groupCountY) const
+{
+    // One invocation per ELEMENTS_PER_INVOCATION elements. Grids wider than maxComputeWorkGroupCount[0]
+    // spill into y, the shader flattens both dimensions back into a linear index.
+    uint32_t elementsPerGroup = m_workgroupSize * m_elementsPerInvocation;
+    uint32_t groupCount = std::max(1u, (elementCount + elementsPerGroup - 1) / elementsPerGroup);
+    groupCountX = std::min(groupCount, m_deviceProperties.limits.maxComputeWorkGroupCount[0]);
+    groupCountY = (groupCount + groupCountX - 1) / groupCountX;
+    if (groupCountY > m_deviceProperties.limits.maxComputeWorkGroupCount[1])
+        throw std::runtime_error("Batch is too large for a single dispatch");
+}
 
-    std::cout << "Waiting for GPU to finish work..." << std::endl;
+void Application::recordTransfers(Frame& frame, VkCommandBuffer uploadCommandBuffer, VkCommandBuffer downloadCommandBuffer)
+{
+    VkDeviceSize dataSize = sizeof(Calculation) * frame.elementCount;
 
-    CHECK_VK_RESULT(vkWaitForFences(m_device, 1, &waitFence, VK_TRUE, std::numeric_limits<uint64_t>::max()),
-                    "Failed to wait for fence");
-    std::cout << "Done" << std::endl;
-    vkDestroyFence(m_device, waitFence, nullptr);
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-    void* mappedMem = nullptr;
-    vkMapMemory(m_device, m_bufferMemory, 0, sizeof(Calculation), 0, &mappedMem);
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = dataSize;
 
-    Calculation* calc = (Calculation*)mappedMem;
-    if (calc)
+    // The data buffer is exclusive, every queue switch is a release on one family and an
+    // acquire on the other with matching queue family indices
+    CHECK_VK_RESULT(vkBeginCommandBuffer(uploadCommandBuffer, &beginInfo),
+                    "Failed to begin command buffer");
     {
-        std::cout << "Result: " << calc->res << std::endl;
+        vkCmdCopyBuffer(uploadCommandBuffer, frame.stagingBuffer.buffer, frame.dataBuffer.buffer, 1, &copyRegion);
+
+        VkBufferMemoryBarrier barrier = bufferBarrier(frame.dataBuffer.buffer, dataSize, VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+                                                      m_transferQueueFamilyIndex, m_computeQueueFamilyIndex);
+        vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                             0, nullptr, 1, &barrier, 0, nullptr);
     }
-    else
+    CHECK_VK_RESULT(vkEndCommandBuffer(uploadCommandBuffer),
+                    "Failed to end command buffer");
+
+    CHECK_VK_RESULT(vkBeginCommandBuffer(downloadCommandBuffer, &beginInfo),
+                    "Failed to begin command buffer");
     {
-        std::cerr << "Error reading result" << std::endl;
-    }
+        VkBufferMemoryBarrier barrier = bufferBarrier(frame.dataBuffer.buffer, dataSize, 0, VK_ACCESS_TRANSFER_READ_BIT,
+                                                      m_computeQueueFamilyIndex, m_transferQueueFamilyIndex);
+        vkCmdPipelineBarrier(downloadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 1, &barrier, 0, nullptr);
 
-    vkUnmapMemory(m_device, m_bufferMemory);
+        vkCmdCopyBuffer(downloadCommandBuffer, frame.dataBuffer.buffer, frame.stagingBuffer.buffer, 1, &copyRegion);
+
+        barrier = bufferBarrier(frame.stagingBuffer.buffer, dataSize, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+        vkCmdPipelineBarrier(downloadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             0, nullptr, 1, &barrier, 0, nullptr);
+    }
+    CHECK_VK_RESULT(vkEndCommandBuffer(downloadCommandBuffer),
+                    "Failed to end command buffer");
 }
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugReportCallbackFn(
@@ -99,6 +528,8 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugReportCallbackFn(
 
 void Application::createInstance()
 {
+    PROFILE_SCOPE("createInstance");
+
     if (this->m_enableValidationLayers && !checkValidationLayerSupport())
         throw std::runtime_error("Validation layers requested, but not available!");
 
@@ -132,19 +563,23 @@ void Application::createInstance()
     std::vector<VkExtensionProperties> extensionProperties(extensionCount);
     vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, extensionProperties.data());
 
-    bool foundExtension = false;
-    for (VkExtensionProperties prop : extensionProperties) {
-        if (strcmp(VK_EXT_DEBUG_REPORT_EXTENSION_NAME, prop.extensionName) == 0) {
-            foundExtension = true;
-            break;
-        }
+    // The debug report callback is only installed together with the validation layers
+    if (m_enableValidationLayers)
+    {
+        bool foundExtension = false;
+        for (VkExtensionProperties prop : extensionProperties) {
+            if (strcmp(VK_EXT_DEBUG_REPORT_EXTENSION_NAME, prop.extensionName) == 0) {
+                foundExtension = true;
+                break;
+            }
 
-    }
+        }
 
-    if (!foundExtension) {
-        throw std::runtime_error("Extension VK_EXT_DEBUG_REPORT_EXTENSION_NAME not supported\n");
+        if (!foundExtension) {
+            throw std::runtime_error("Extension VK_EXT_DEBUG_REPORT_EXTENSION_NAME not supported\n");
+        }
+        enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
     }
-    enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 
     instanceCreateInfo.enabledExtensionCount = enabledExtensions.size();
     instanceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
@@ -183,6 +618,8 @@ void Application::createInstance()
 
 void Application::findPhysicalDevice()
 {
+    PROFILE_SCOPE("findPhysicalDevice");
+
     uint32_t deviceCount;
     vkEnumeratePhysicalDevices(m_instance, &deviceCount, NULL);
     if (deviceCount == 0) {
@@ -192,76 +629,173 @@ void Application::findPhysicalDevice()
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data());
 
-    for (VkPhysicalDevice dev : devices)
+    uint64_t bestScore = 0;
+    if (m_physicalDeviceIndex >= 0)
+    {
+        if ((uint32_t)m_physicalDeviceIndex >= deviceCount)
+            throw std::runtime_error("Physical device index out of range");
+
+        m_physicalDevice = devices[m_physicalDeviceIndex];
+        bestScore = scorePhysicalDevice(m_physicalDevice, m_workgroupSize);
+    }
+    else
+    {
+        for (VkPhysicalDevice dev : devices)
+        {
+            uint64_t score = scorePhysicalDevice(dev, m_workgroupSize);
+            if (score > bestScore)
+            {
+                bestScore = score;
+                m_physicalDevice = dev;
+            }
+        }
+    }
+
+    if (bestScore == 0)
+        throw std::runtime_error("Could not find a device that can run the compute shader");
+
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &m_deviceProperties);
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
+
+    m_subgroupProperties = {};
+    m_subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    if (m_deviceProperties.apiVersion >= VK_API_VERSION_1_1)
     {
-        m_physicalDevice = dev;
-        break;
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &m_subgroupProperties;
+        vkGetPhysicalDeviceProperties2(m_physicalDevice, &properties);
+        m_subgroupProperties.pNext = nullptr;
     }
+
+    m_unifiedMemory = hasUnifiedMemory();
+    std::cout << "Memory: " << (m_unifiedMemory ? "unified, working buffers are host-visible"
+                                                : "discrete, working buffers are device-local with staging") << std::endl;
 }
 
 void Application::createDevice()
 {
-    VkDeviceQueueCreateInfo queueCreateInfo = {};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    uint32_t queueFamilyIndex = getComputeQueueFamilyIndex();
-    queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-    queueCreateInfo.queueCount = 1;
+    PROFILE_SCOPE("createDevice");
+
+    m_computeQueueFamilyIndex = getComputeQueueFamilyIndex();
+    m_transferQueueFamilyIndex = getTransferQueueFamilyIndex(m_computeQueueFamilyIndex);
+
+    // One queue from the compute family, plus one from the transfer family if it is a different one
     float queuePriorities = 1.0;
-    queueCreateInfo.pQueuePriorities = &queuePriorities;
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (uint32_t queueFamilyIndex : { m_computeQueueFamilyIndex, m_transferQueueFamilyIndex })
+    {
+        if (!queueCreateInfos.empty() && queueFamilyIndex == m_computeQueueFamilyIndex)
+            break;
+
+        VkDeviceQueueCreateInfo queueCreateInfo = {};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriorities;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+
+    // Optional extensions, each enabled only if the device has it
+    std::vector<const char*> enabledExtensions;
+    bool hostImport = m_deviceProperties.apiVersion >= VK_API_VERSION_1_1 &&
+                      isDeviceExtensionSupported(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    if (hostImport)
+        enabledExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    bool pushDescriptors = isDeviceExtensionSupported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if (pushDescriptors)
+        enabledExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
+    // 16-bit and 8-bit storage and scalar block layout for typed buffers, core in Vulkan 1.2. Only
+    // the storage buffer bits are enabled.
+    VkPhysicalDevice16BitStorageFeatures storage16Bit = {};
+    storage16Bit.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+    VkPhysicalDevice8BitStorageFeatures storage8Bit = {};
+    storage8Bit.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES;
+    VkPhysicalDeviceScalarBlockLayoutFeatures scalarBlockLayout = {};
+    scalarBlockLayout.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SCALAR_BLOCK_LAYOUT_FEATURES;
+    m_storageFeatures = StorageFeatures();
+    if (m_deviceProperties.apiVersion >= VK_API_VERSION_1_1)
+    {
+        bool vulkan12 = m_deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+        bool has8BitStorage = vulkan12 || isDeviceExtensionSupported(VK_KHR_8BIT_STORAGE_EXTENSION_NAME);
+        bool hasScalarBlockLayout = vulkan12 || isDeviceExtensionSupported(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
+        void** next = &storage16Bit.pNext;
+        if (has8BitStorage)
+        {
+            *next = &storage8Bit;
+            next = &storage8Bit.pNext;
+        }
+        if (hasScalarBlockLayout)
+            *next = &scalarBlockLayout;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &storage16Bit;
+        vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features);
+
+        m_storageFeatures.storage16Bit = storage16Bit.storageBuffer16BitAccess == VK_TRUE;
+        m_storageFeatures.storage8Bit = storage8Bit.storageBuffer8BitAccess == VK_TRUE;
+        m_storageFeatures.scalarBlockLayout = scalarBlockLayout.scalarBlockLayout == VK_TRUE;
+        storage16Bit.uniformAndStorageBuffer16BitAccess = VK_FALSE;
+        storage16Bit.storagePushConstant16 = VK_FALSE;
+        storage16Bit.storageInputOutput16 = VK_FALSE;
+        storage8Bit.uniformAndStorageBuffer8BitAccess = VK_FALSE;
+        storage8Bit.storagePushConstant8 = VK_FALSE;
+
+        if (!vulkan12 && m_storageFeatures.storage8Bit)
+            enabledExtensions.push_back(VK_KHR_8BIT_STORAGE_EXTENSION_NAME);
+        if (!vulkan12 && m_storageFeatures.scalarBlockLayout)
+            enabledExtensions.push_back(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
+    }
 
     VkDeviceCreateInfo deviceCreateInfo = {};
 
     VkPhysicalDeviceFeatures deviceFeatures = {};
 
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.enabledLayerCount = m_validationLayers.size();
-    deviceCreateInfo.ppEnabledLayerNames = m_validationLayers.data();
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-    deviceCreateInfo.queueCreateInfoCount = 1;
+    if (m_deviceProperties.apiVersion >= VK_API_VERSION_1_1)
+        deviceCreateInfo.pNext = &storage16Bit;
+    deviceCreateInfo.enabledLayerCount = m_enableValidationLayers ? m_validationLayers.size() : 0;
+    deviceCreateInfo.ppEnabledLayerNames = m_enableValidationLayers ? m_validationLayers.data() : nullptr;
+    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+    deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     CHECK_VK_RESULT(vkCreateDevice(m_physicalDevice, &deviceCreateInfo, NULL, &m_device),
                     "Failed to create device");
 
-    vkGetDeviceQueue(m_device, queueFamilyIndex, 0, &m_computeQueue);
+    vkGetDeviceQueue(m_device, m_computeQueueFamilyIndex, 0, &m_computeQueue);
+    m_transferQueue = VK_NULL_HANDLE;
+    if (m_transferQueueFamilyIndex != m_computeQueueFamilyIndex)
+        vkGetDeviceQueue(m_device, m_transferQueueFamilyIndex, 0, &m_transferQueue);
+
+    m_cmdPushDescriptorSet = nullptr;
+    if (pushDescriptors)
+        m_cmdPushDescriptorSet = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(m_device, "vkCmdPushDescriptorSetKHR");
+    std::cout << "Storage: 16-bit " << (m_storageFeatures.storage16Bit ? "yes" : "no") << ", 8-bit "
+              << (m_storageFeatures.storage8Bit ? "yes" : "no") << ", scalar layout "
+              << (m_storageFeatures.scalarBlockLayout ? "yes" : "no") << std::endl;
+    std::cout << "Descriptors: " << (m_cmdPushDescriptorSet ? "pushed while recording" : "cached sets") << std::endl;
+
+    m_hostMemoryImporter.init(m_physicalDevice, m_device, m_memoryProperties, hostImport);
+    if (m_hostMemoryImporter.isSupported())
+        std::cout << "Host memory import: " << m_hostMemoryImporter.getAlignment() << " byte alignment" << std::endl;
+    else
+        std::cout << "Host memory import: not supported, batches are staged" << std::endl;
+
+    std::cout << "Queues: compute family " << m_computeQueueFamilyIndex;
+    if (m_transferQueue != VK_NULL_HANDLE)
+        std::cout << ", transfer family " << m_transferQueueFamilyIndex << std::endl;
+    else
+        std::cout << ", copies share the compute queue" << std::endl;
 }
 
-void Application::createDataBufferAndDescriptorSet()
+void Application::createDescriptorSetLayoutAndPool()
 {
-    // Create buffer
-
-    VkBufferCreateInfo bufferCreateInfo = {};
-    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.size = sizeof(Calculation);
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    CHECK_VK_RESULT(vkCreateBuffer(m_device, &bufferCreateInfo, nullptr, &m_buffer),
-                    "Failed to create buffer");
-
-    VkMemoryRequirements memReq;
-    vkGetBufferMemoryRequirements(m_device, m_buffer, &memReq);
-
-    VkMemoryAllocateInfo allocateInfo = {};
-    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocateInfo.allocationSize = memReq.size;
-    allocateInfo.memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-
-    CHECK_VK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &m_bufferMemory),
-                    "Failed to allocate buffer memory");
-
-    CHECK_VK_RESULT(vkBindBufferMemory(m_device, m_buffer, m_bufferMemory, 0),
-                    "Failed to bind buffer memory");
-
-    Calculation calc;
-    calc.f1 = 3.14f;
-    calc.f2 = 8.43f;
-    calc.res = 0.f;
-
-    void* mappedMem = nullptr;
-    vkMapMemory(m_device, m_bufferMemory, 0, sizeof(Calculation), 0, &mappedMem);
-    memcpy(mappedMem, &calc, sizeof(calc));
-    vkUnmapMemory(m_device, m_bufferMemory);
+    PROFILE_SCOPE("createDescriptorSetLayoutAndPool");
 
     // Create descriptor set layout
 
@@ -273,92 +807,366 @@ void Application::createDataBufferAndDescriptorSet()
 
     VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
     layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.flags = m_cmdPushDescriptorSet ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
     layoutCreateInfo.bindingCount = 1;
     layoutCreateInfo.pBindings = &descriptorSetLayoutBinding;
 
     CHECK_VK_RESULT(vkCreateDescriptorSetLayout(m_device, &layoutCreateInfo, nullptr, &m_descriptorSetLayout),
                     "Failed to create Descriptor set layout");
 
-    // Create descriptor pool
+    // Sets are taken from the allocator as buffers get bound, see bindDataBuffer
+    m_descriptorAllocator.init(m_device);
+}
 
-    VkDescriptorPoolSize descriptorPoolSize = {};
-    descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorPoolSize.descriptorCount = 1;
+void Application::reserveDataBuffer(Frame& frame, uint32_t elementCount)
+{
+    if (elementCount > frame.capacity)
+    {
+        // Checked first, a rejected batch leaves the frame usable for smaller ones
+        VkDeviceSize dataSize = sizeof(Calculation) * elementCount;
+        if (dataSize > m_deviceProperties.limits.maxStorageBufferRange)
+            throw std::runtime_error("Batch exceeds maxStorageBufferRange");
+
+        // The frame has been retired, so its old buffers are no longer in use. Until the new ones
+        // exist the frame holds none, so a failed allocation is retried on the next batch.
+        releaseDescriptors(frame.dataBuffer.buffer);
+        destroyBuffer(frame.dataBuffer);
+        destroyBuffer(frame.stagingBuffer);
+        frame.capacity = 0;
+        frame.boundBuffer = VK_NULL_HANDLE;
+
+        frame.dataBuffer = createBuffer(dataSize,
+                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                        BufferUsage::GpuOnly);
+        if (!frame.dataBuffer.hostVisible)
+        {
+            frame.stagingBuffer = createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                               BufferUsage::Staging);
+        }
 
-    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
-    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    descriptorPoolCreateInfo.maxSets = 1;
-    descriptorPoolCreateInfo.poolSizeCount = 1;
-    descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+        frame.capacity = elementCount;
+    }
 
-    CHECK_VK_RESULT(vkCreateDescriptorPool(m_device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool),
-                    "Failed to create descriptor pool");
+    frame.importedBuffer = VK_NULL_HANDLE;
+    bindDataBuffer(frame, frame.dataBuffer.buffer, 0, elementCount);
+}
 
-    // Allocate descriptor set
+void Application::bindDataBuffer(Frame& frame, VkBuffer buffer, VkDeviceSize offset, uint32_t elementCount)
+{
+    if (buffer == frame.boundBuffer && offset == frame.boundOffset && elementCount == frame.boundElementCount)
+        return;
 
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_descriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &m_descriptorSetLayout;
+    frame.commandsRecorded = false;
 
-    CHECK_VK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptorSet),
-                    "Failed to allocate descriptor set");
+    // The range defines calcs.length() in the shader, which bounds the last workgroup. A range bound
+    // before, like the chunks of a registered file, gets its set back from the cache unchanged.
+    if (m_cmdPushDescriptorSet == nullptr)
+        frame.descriptorSet = m_descriptorAllocator.getSet(m_descriptorSetLayout, { buffer, offset, sizeof(Calculation) * elementCount });
 
-    // Update descriptor set
+    frame.boundBuffer = buffer;
+    frame.boundOffset = offset;
+    frame.boundElementCount = elementCount;
+}
+
+void Application::cmdBindDataBuffer(VkCommandBuffer commandBuffer, const Frame& frame)
+{
+    if (m_cmdPushDescriptorSet == nullptr)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+        return;
+    }
 
     VkDescriptorBufferInfo descriptorBufferInfo = {};
-    descriptorBufferInfo.buffer = m_buffer;
-    descriptorBufferInfo.offset = 0;
-    descriptorBufferInfo.range = sizeof(Calculation);
+    descriptorBufferInfo.buffer = frame.boundBuffer;
+    descriptorBufferInfo.offset = frame.boundOffset;
+    descriptorBufferInfo.range = sizeof(Calculation) * frame.boundElementCount;
 
     VkWriteDescriptorSet writeDescriptorSet = {};
     writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeDescriptorSet.dstSet = m_descriptorSet;
     writeDescriptorSet.dstBinding = 0;
     writeDescriptorSet.descriptorCount = 1;
     writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
 
-    vkUpdateDescriptorSets(m_device, 1, &writeDescriptorSet, 0, NULL);
+    m_cmdPushDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &writeDescriptorSet);
+}
+
+void Application::releaseDescriptors(VkBuffer buffer)
+{
+    if (buffer == VK_NULL_HANDLE)
+        return;
+
+    // A frame still bound to the buffer would skip bindDataBuffer for a new buffer with the same handle
+    m_descriptorAllocator.releaseBuffer(buffer);
+    for (Frame& frame : m_frames)
+    {
+        if (frame.boundBuffer != buffer)
+            continue;
+        frame.boundBuffer = VK_NULL_HANDLE;
+        frame.descriptorSet = VK_NULL_HANDLE;
+        frame.commandsRecorded = false;
+    }
+}
+
+void Application::createPipelineCache()
+{
+    // Per device model, so several open devices do not evict each other's cache file
+    char path[64];
+    snprintf(path, sizeof(path), "pipeline_cache_%04x_%04x.bin", m_deviceProperties.vendorID, m_deviceProperties.deviceID);
+    m_pipelineCache.load(m_device, m_deviceProperties, path);
 }
 
 void Application::createComputePipeline()
 {
-    VkPipelineShaderStageCreateInfo compShader = ShaderLoader::compileAndLoadShader(m_device, "../Shaders/compShader.glsl", "compShader", VK_SHADER_STAGE_COMPUTE_BIT);
+    PROFILE_SCOPE("createComputePipeline");
+
+    if (m_workgroupSize > m_deviceProperties.limits.maxComputeWorkGroupSize[0] ||
+        m_workgroupSize > m_deviceProperties.limits.maxComputeWorkGroupInvocations ||
+        m_workgroupSize == 0 || m_elementsPerInvocation == 0)
+        throw std::runtime_error("Workgroup size is not supported by the device");
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(SmallBatchConstants);
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCreateInfo.setLayoutCount = 1;
     pipelineLayoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
     CHECK_VK_RESULT(vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, NULL, &m_pipelineLayout),
                     "Failed to create compute pipeline layout");
 
-    VkComputePipelineCreateInfo pipelineCreateInfo = {};
-    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    pipelineCreateInfo.stage = compShader;
-    pipelineCreateInfo.layout = m_pipelineLayout;
+    // Every variant shares one SPIR-V module, the tuning knobs are specialization constants
+    std::vector<PipelineBuilder::ComputePipelineDesc> descs(2);
+    descs[0].shader = { "../Shaders/compShader.glsl", "compShader", VK_SHADER_STAGE_COMPUTE_BIT, {} };
+    descs[0].layout = m_pipelineLayout;
+    descs[0].specializationConstants = { m_workgroupSize, m_elementsPerInvocation };
+    descs[1].shader = { "../Shaders/pushShader.glsl", "pushShader", VK_SHADER_STAGE_COMPUTE_BIT, {} };
+    descs[1].layout = m_pipelineLayout;
+
+    ThreadPool& compilePool = ShaderLoader::getCompilePool();
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<ShaderModuleRef> shaderModules;
+    std::vector<VkPipeline> pipelines = PipelineBuilder::createComputePipelines(m_shaderModuleCache, m_pipelineCache.get(), descs, compilePool,
+                                                                                PipelineBuilder::Mode::PerThread, &shaderModules);
+    auto end = std::chrono::high_resolution_clock::now();
+    m_pipeline = pipelines[0];
+    m_smallBatchPipeline = pipelines[1];
+    m_shaderModules = std::move(shaderModules);
+
+    std::cout << "Pipelines: " << descs.size() << " in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms on "
+              << compilePool.getThreadCount() << " threads (" << (m_pipelineCache.isWarm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
+    std::cout << "SPIR-V cache: " << ShaderLoader::getSpirvCache().getHits() << " hits, "
+              << ShaderLoader::getSpirvCache().getMisses() << " misses, " << m_shaderModuleCache.getModuleCount()
+              << " shader modules" << std::endl;
+
+    // Recorded command buffers reference the old pipeline, see isRecordingValid
+    ++m_pipelineGeneration;
+}
+
+void Application::destroyComputePipeline()
+{
+    vkDestroyPipeline(m_device, m_pipeline, nullptr);
+    vkDestroyPipeline(m_device, m_smallBatchPipeline, nullptr);
+    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+    m_pipeline = VK_NULL_HANDLE;
+    m_smallBatchPipeline = VK_NULL_HANDLE;
+    m_pipelineLayout = VK_NULL_HANDLE;
+}
+
+void Application::setWorkgroupSize(uint32_t workgroupSize)
+{
+    setKernelParams(workgroupSize, m_elementsPerInvocation);
+}
+
+void Application::setKernelParams(uint32_t workgroupSize, uint32_t elementsPerInvocation)
+{
+    if (workgroupSize == m_workgroupSize && elementsPerInvocation == m_elementsPerInvocation)
+        return;
+
+    m_workgroupSize = workgroupSize;
+    m_elementsPerInvocation = elementsPerInvocation;
+    if (m_pipeline == VK_NULL_HANDLE)
+        return;
 
-    CHECK_VK_RESULT(vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &m_pipeline),
-                    "Failed to create compute pipeline");
+    // The old pipelines may still be referenced by frames in flight
+    for (Frame& frame : m_frames)
+        retireFrame(frame);
+    m_smallBatchRing.waitAll();
+
+    destroyComputePipeline();
+    createComputePipeline();
 }
 
-void Application::createCommandBuffer()
+bool Application::loadKernelTuning()
 {
-    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
-    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    commandPoolCreateInfo.flags = 0;
-    commandPoolCreateInfo.queueFamilyIndex = getComputeQueueFamilyIndex();
-    CHECK_VK_RESULT(vkCreateCommandPool(m_device, &commandPoolCreateInfo, NULL, &m_commandPool),
-                    "Failed to create command pool");
+    TuningCache::Entry entry;
+    if (!m_autotune || !m_tuningCache.lookup(m_deviceProperties, entry))
+        return false;
+
+    // The file may come from an older build with other limits, fall back to tuning again
+    const VkPhysicalDeviceLimits& limits = m_deviceProperties.limits;
+    if (entry.workgroupSize > limits.maxComputeWorkGroupSize[0] || entry.workgroupSize > limits.maxComputeWorkGroupInvocations)
+        return false;
+
+    m_workgroupSize = entry.workgroupSize;
+    m_elementsPerInvocation = entry.elementsPerInvocation;
+    std::cout << "Kernel tuning: workgroup size " << m_workgroupSize << ", " << m_elementsPerInvocation
+              << " elements per invocation (cached)" << std::endl;
+    return true;
+}
+
+void Application::autotuneKernel()
+{
+    PROFILE_SCOPE("autotuneKernel");
+
+    const VkPhysicalDeviceLimits& limits = m_deviceProperties.limits;
+    uint32_t elementCount = std::min<uint32_t>(1 << 20, limits.maxStorageBufferRange / sizeof(Calculation));
+
+    TuningCache::Entry best;
+    double bestSeconds = std::numeric_limits<double>::max();
+
+    for (uint32_t workgroupSize = 64; workgroupSize <= 1024; workgroupSize *= 2)
+    {
+        if (workgroupSize > limits.maxComputeWorkGroupSize[0] || workgroupSize > limits.maxComputeWorkGroupInvocations)
+            break;
+
+        for (uint32_t elementsPerInvocation : { 1u, 4u })
+        {
+            setKernelParams(workgroupSize, elementsPerInvocation);
+
+            // Fastest of a few runs, the first one also pays for buffer allocation
+            double seconds = std::numeric_limits<double>::max();
+            for (uint32_t i = 0; i < 4; ++i)
+                seconds = std::min(seconds, timeDispatch(elementCount, 8));
 
-    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
-    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocateInfo.commandPool = m_commandPool;
-    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocateInfo.commandBufferCount = 1;
-    CHECK_VK_RESULT(vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, &m_commandBuffer),
-                    "Failed to allocate command buffer");
+            if (seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+                best.workgroupSize = workgroupSize;
+                best.elementsPerInvocation = elementsPerInvocation;
+            }
+        }
+    }
+
+    if (best.workgroupSize == 0)
+        throw std::runtime_error("No kernel variant fits the device limits");
+
+    setKernelParams(best.workgroupSize, best.elementsPerInvocation);
+    m_tuningCache.store(m_deviceProperties, best);
+    std::cout << "Kernel tuning: workgroup size " << m_workgroupSize << ", " << m_elementsPerInvocation
+              << " elements per invocation (" << elementCount * 8 / bestSeconds << " elements/sec)" << std::endl;
+}
+
+double Application::timeDispatch(uint32_t elementCount, uint32_t repeatCount)
+{
+    // Only the dispatches, the copies would hide the difference between variants
+    uint32_t slot = m_submissionRing.acquire();
+    Frame& frame = m_frames[slot];
+    retireFrame(frame);
+    reserveDataBuffer(frame, elementCount);
+    frame.commandsRecorded = false;
+
+    uint32_t groupCountX, groupCountY;
+    getDispatchSize(elementCount, groupCountX, groupCountY);
+
+    VkCommandBuffer commandBuffer = m_submissionRing.getCommandBuffer(slot);
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
+                    "Failed to begin command buffer");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    cmdBindDataBuffer(commandBuffer, frame);
+    for (uint32_t i = 0; i < repeatCount; ++i)
+    {
+        // Serialize the repeats like separate batches would be
+        if (i > 0)
+        {
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                                 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+        vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+    }
+    CHECK_VK_RESULT(vkEndCommandBuffer(commandBuffer),
+                    "Failed to end command buffer");
+
+    auto start = std::chrono::high_resolution_clock::now();
+    m_submissionRing.wait(m_submissionRing.submit(slot));
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void Application::createFrames()
+{
+    PROFILE_SCOPE("createFrames");
+
+    // Without staging there is nothing to copy, the transfer queue would only add semaphore waits
+    if (m_transferQueue != VK_NULL_HANDLE && !m_unifiedMemory)
+        m_submissionRing.init(m_device, m_computeQueue, m_computeQueueFamilyIndex, m_transferQueue, m_transferQueueFamilyIndex, m_framesInFlight);
+    else
+        m_submissionRing.init(m_device, m_computeQueue, m_computeQueueFamilyIndex, m_framesInFlight);
+
+    // Descriptor sets are bound per buffer, not per frame, see bindDataBuffer
+    m_frames.resize(m_framesInFlight);
+
+#ifdef VK_PROFILE
+    uint32_t queueFamilyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, NULL);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+    m_timestampValidBits = queueFamilies[m_computeQueueFamilyIndex].timestampValidBits;
+
+    if (m_timestampValidBits > 0)
+    {
+        VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCreateInfo.queryCount = m_framesInFlight * 2;
+        CHECK_VK_RESULT(vkCreateQueryPool(m_device, &queryPoolCreateInfo, nullptr, &m_timestampQueryPool),
+                        "Failed to create timestamp query pool");
+    }
+#endif
+}
+
+void Application::destroyFrames()
+{
+    m_submissionRing.destroy();
+
+    for (Frame& frame : m_frames)
+    {
+        m_descriptorAllocator.releaseBuffer(frame.dataBuffer.buffer);
+        destroyBuffer(frame.dataBuffer);
+        destroyBuffer(frame.stagingBuffer);
+    }
+    m_frames.clear();
+
+#ifdef VK_PROFILE
+    if (m_timestampQueryPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(m_device, m_timestampQueryPool, nullptr);
+    m_timestampQueryPool = VK_NULL_HANDLE;
+#endif
+}
+
+void Application::createSmallBatchResources()
+{
+    PROFILE_SCOPE("createSmallBatchResources");
+
+    if (sizeof(SmallBatchConstants) > m_deviceProperties.limits.maxPushConstantsSize)
+        throw std::runtime_error("Push constant range of pushShader.glsl exceeds maxPushConstantsSize");
+
+    m_smallBatchRing.init(m_device, m_computeQueue, m_computeQueueFamilyIndex, 1);
+
+    m_smallBatchResults = createBuffer(sizeof(float) * maxSmallBatchSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, BufferUsage::Readback);
+
+    // Bound once, computeSmallBatch never touches the descriptor again
+    if (m_cmdPushDescriptorSet == nullptr)
+        m_smallBatchDescriptorSet = m_descriptorAllocator.getSet(m_descriptorSetLayout, { m_smallBatchResults.buffer, 0, VK_WHOLE_SIZE });
 }
 
 bool Application::checkValidationLayerSupport()
@@ -388,6 +1196,106 @@ bool Application::checkValidationLayerSupport()
     return true;
 }
 
+uint64_t Application::scorePhysicalDevice(VkPhysicalDevice physicalDevice, uint32_t workgroupSize)
+{
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    uint32_t queueFamilyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    uint32_t computeQueueCount = 0;
+    for (const VkQueueFamilyProperties& family : queueFamilies)
+    {
+        if (family.queueFlags & VK_QUEUE_COMPUTE_BIT)
+            computeQueueCount += family.queueCount;
+    }
+
+    if (computeQueueCount == 0 ||
+        workgroupSize > props.limits.maxComputeWorkGroupSize[0] ||
+        workgroupSize > props.limits.maxComputeWorkGroupInvocations)
+        return 0;
+
+    VkDeviceSize deviceLocalBytes = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            deviceLocalBytes = std::max(deviceLocalBytes, memoryProperties.memoryHeaps[i].size);
+    }
+
+    // Device type dominates, then the largest device-local heap, queue count and limits break ties
+    uint64_t typeRank = 1;
+    switch (props.deviceType)
+    {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: typeRank = 5; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: typeRank = 4; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: typeRank = 3; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: typeRank = 2; break;
+        default: break;
+    }
+
+    uint64_t score = typeRank * 1000000000ull;
+    score += std::min<uint64_t>(deviceLocalBytes >> 20, 999999) * 1000;
+    score += std::min(computeQueueCount, 99u) * 10;
+    if (props.limits.maxComputeWorkGroupInvocations >= 1024)
+        score += 1;
+    if (props.limits.maxStorageBufferRange >= (1u << 30))
+        score += 1;
+    return score;
+}
+
+std::vector<uint32_t> Application::findSuitableDevices()
+{
+    // A bare instance only to list and score the devices
+    VkApplicationInfo appInfo = {};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Vulkan Compute Basic Template";
+    appInfo.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instanceCreateInfo = {};
+    instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceCreateInfo.pApplicationInfo = &appInfo;
+
+    // Fails without any installed driver, which only means there is no suitable device
+    VkInstance instance;
+    if (vkCreateInstance(&instanceCreateInfo, nullptr, &instance) != VK_SUCCESS)
+        return {};
+
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+    std::vector<uint32_t> suitable;
+    for (uint32_t i = 0; i < deviceCount; ++i)
+    {
+        if (scorePhysicalDevice(devices[i], defaultWorkgroupSize) > 0)
+            suitable.push_back(i);
+    }
+
+    vkDestroyInstance(instance, nullptr);
+    return suitable;
+}
+
+bool Application::isDeviceExtensionSupported(const char* extensionName) const
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, extensions.data());
+
+    for (const VkExtensionProperties& extension : extensions)
+    {
+        if (strcmp(extension.extensionName, extensionName) == 0)
+            return true;
+    }
+    return false;
+}
+
 uint32_t Application::getComputeQueueFamilyIndex()
 {
     uint32_t queueFamilyCount;
@@ -397,36 +1305,166 @@ uint32_t Application::getComputeQueueFamilyIndex()
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
 
-    uint32_t i = 0;
-    for (; i < queueFamilies.size(); ++i) {
+    // Prefer an async compute family without graphics, it does not compete with rendering work
+    uint32_t computeFamily = UINT32_MAX;
+    for (uint32_t i = 0; i < queueFamilies.size(); ++i) {
         VkQueueFamilyProperties props = queueFamilies[i];
 
-        if (props.queueCount > 0 && (props.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
-            break;
-        }
+        if (props.queueCount == 0 || !(props.queueFlags & VK_QUEUE_COMPUTE_BIT))
+            continue;
+
+        if (!(props.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+            return i;
+        if (computeFamily == UINT32_MAX)
+            computeFamily = i;
     }
 
-    if (i == queueFamilies.size()) {
+    if (computeFamily == UINT32_MAX) {
         throw std::runtime_error("Could not find a queue family that supports operations");
     }
 
-    return i;
+    return computeFamily;
 }
 
-uint32_t Application::findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
+uint32_t Application::getTransferQueueFamilyIndex(uint32_t computeQueueFamilyIndex)
 {
-    VkPhysicalDeviceMemoryProperties memoryProperties;
+    uint32_t queueFamilyCount;
+
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, NULL);
 
-    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memoryProperties);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
 
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
-        if ((memoryTypeBits & (1 << i)) &&
-            ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties))
+    // A transfer-only family is usually backed by the copy engines
+    for (uint32_t i = 0; i < queueFamilies.size(); ++i) {
+        VkQueueFamilyProperties props = queueFamilies[i];
+
+        if (i != computeQueueFamilyIndex && props.queueCount > 0 && (props.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+            !(props.queueFlags & (VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT)))
             return i;
     }
-    return -1;
+
+    // Compute families always support transfers, copies then go through the compute queue
+    return computeQueueFamilyIndex;
+}
+
+Buffer Application::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, BufferUsage bufferUsage)
+{
+    Buffer buffer;
+    buffer.size = size;
+
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = usage;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    CHECK_VK_RESULT(vkCreateBuffer(m_device, &bufferCreateInfo, nullptr, &buffer.buffer),
+                    "Failed to create buffer");
+
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memReq);
+
+    uint32_t memoryTypeIndex = 0;
+    switch (bufferUsage)
+    {
+        case BufferUsage::GpuOnly:
+            if (m_unifiedMemory)
+                memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            else
+                memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            break;
+        case BufferUsage::Staging:
+        case BufferUsage::Readback:
+            // Cached memory keeps the readback memcpy from going through uncached writes-combined pages.
+            // It may not be coherent, which computeBatch handles with explicit flushes and invalidates.
+            memoryTypeIndex = findMemoryType(memReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                             VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+            break;
+    }
+
+    VkMemoryPropertyFlags propertyFlags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    buffer.hostVisible = (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+
+    buffer.allocation = m_memoryArena.allocate(memReq, memoryTypeIndex);
+
+    CHECK_VK_RESULT(vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset),
+                    "Failed to bind buffer memory");
+
+    return buffer;
 }
 
+void Application::destroyBuffer(Buffer& buffer)
+{
+    if (buffer.buffer != VK_NULL_HANDLE)
+        vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+    m_memoryArena.free(buffer.allocation);
+    buffer = Buffer();
+}
 
+void Application::createMemoryArena()
+{
+    PROFILE_SCOPE("createMemoryArena");
 
+    m_memoryArena.init(m_device, m_deviceProperties, m_memoryProperties);
+}
 
+bool Application::hasUnifiedMemory()
+{
+    if (m_deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+        m_deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU)
+        return true;
+
+    // Find the largest device-local heap. Discrete GPUs may expose a small host-visible window
+    // (the 256 MiB BAR) as a separate heap, which must not count as unified memory.
+    int32_t largestHeap = -1;
+    for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; ++i)
+    {
+        if ((m_memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+            (largestHeap < 0 || m_memoryProperties.memoryHeaps[i].size > m_memoryProperties.memoryHeaps[largestHeap].size))
+            largestHeap = (int32_t)i;
+    }
+
+    // Without any device-local heap everything lives in system memory anyway
+    if (largestHeap < 0)
+        return true;
+
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+    {
+        VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[i].propertyFlags;
+        if (m_memoryProperties.memoryTypes[i].heapIndex == (uint32_t)largestHeap &&
+            (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) &&
+            (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+            return true;
+    }
+
+    return false;
+}
+
+uint32_t Application::findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+    if (preferred != 0)
+    {
+        for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i) {
+            if ((memoryTypeBits & (1 << i)) &&
+                ((m_memoryProperties.memoryTypes[i].propertyFlags & (required | preferred)) == (required | preferred)))
+                return i;
+        }
+    }
+
+    return findMemoryType(memoryTypeBits, required);
+}
+
+uint32_t Application::findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties)
+{
+    const VkPhysicalDeviceMemoryProperties& memoryProperties = m_memoryProperties;
+
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+        if ((memoryTypeBits & (1 << i)) &&
+            ((memoryProperties.memoryTypes[i].propertyFlags & properties) == properties))
+            return i;
+    }
+
+    throw std::runtime_error("Could not find a suitable memory type");
+}
@@ -1,49 +1,246 @@
 #pragma once
 
-#define VK_DEBUG
-
 #include <vulkan/vulkan.h>
 #include <vector>
 
-class Application
+#include "Buffer.h"
+#include "ComputeBackend.h"
+#include "DescriptorAllocator.h"
+#include "HostMemoryImporter.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "ShaderModuleCache.h"
+#include "SubmissionRing.h"
+#include "TuningCache.h"
+
+// The Vulkan backend
+class Application : public ComputeBackend
 {
 public:
-    void Run();
+    // Creates the instance, device and pipeline. Run does this itself, callers that use
+    // computeBatch directly (DeviceGroup) set up and shut down explicitly.
+    void setup() override;
+    // Also cleans up after a setup that threw
+    void shutdown() override;
+    std::string getName() const override { return m_deviceProperties.deviceName; }
+
+    // Uses the device at this index of vkEnumeratePhysicalDevices instead of the highest scoring one.
+    // Must be called before setup.
+    void setPhysicalDeviceIndex(int32_t index) { m_physicalDeviceIndex = index; }
+    // Ranks devices for compute work, 0 if the device cannot run compShader.glsl at this workgroup size
+    static uint64_t scorePhysicalDevice(VkPhysicalDevice physicalDevice, uint32_t workgroupSize);
+    // Indices of the devices that can run the default kernel, empty without a Vulkan driver
+    static std::vector<uint32_t> findSuitableDevices();
+    const VkPhysicalDeviceProperties& getDeviceProperties() const { return m_deviceProperties; }
+    // Zeroed on Vulkan 1.0 devices, which have no subgroup operations
+    const VkPhysicalDeviceSubgroupProperties& getSubgroupProperties() const { return m_subgroupProperties; }
+    uint32_t getWorkgroupSize() const { return m_workgroupSize; }
+
+    // Storage buffer features enabled on the device, see BufferLayout
+    struct StorageFeatures
+    {
+        bool storage16Bit = false;      // float16_t, int16_t and uint16_t members
+        bool storage8Bit = false;       // int8_t and uint8_t members
+        bool scalarBlockLayout = false; // layout(scalar) blocks
+    };
+    const StorageFeatures& getStorageFeatures() const { return m_storageFeatures; }
+
+    using ComputeBackend::computeBatchAsync;
+
+    // Uploads and submits without waiting for the GPU. The results are written back into
+    // calculations by waitBatch, or when the frame is reused.
+    BatchHandle computeBatchAsync(Calculation* calculations, uint32_t elementCount) override;
+    bool isBatchComplete(const BatchHandle& batch) const override;
+    void waitBatch(const BatchHandle& batch) override;
+    // A batch is bound through one storage buffer descriptor
+    uint32_t getMaxBatchSize() const override { return m_deviceProperties.limits.maxStorageBufferRange / sizeof(Calculation); }
+
+    // Passes the operands through push constants. Nothing is written to a buffer and no
+    // descriptor is updated per call.
+    void computeSmallBatch(Calculation* calculations, uint32_t elementCount) override;
+
+    // Number of batches that may be in flight at once, up to m_maxFramesInFlight
+    void setFramesInFlight(uint32_t depth);
+    // Rebuild the pipeline with new specialization constants
+    void setWorkgroupSize(uint32_t workgroupSize);
+    void setKernelParams(uint32_t workgroupSize, uint32_t elementsPerInvocation);
+    // Time a few kernel variants on the first run of a device and remember the fastest in kernel_tuning.txt.
+    // Must be called before setup.
+    void setAutotune(bool enabled) { m_autotune = enabled; }
+
+    // Batches that lie inside [pointer, pointer + size) skip the staging copy, the device reads and
+    // writes that memory in place. pointer and size must be multiples of getHostImportAlignment().
+    // Returns false without VK_EXT_external_memory_host or if the driver cannot import the range.
+    bool registerHostMemory(void* pointer, size_t size);
+    // Waits for the batches still running on the memory
+    void unregisterHostMemory(void* pointer);
+    // 0 if host memory cannot be imported
+    VkDeviceSize getHostImportAlignment() const { return m_hostMemoryImporter.isSupported() ? m_hostMemoryImporter.getAlignment() : 0; }
+
+    struct IngestionStats
+    {
+        // Staging path, copySeconds covers the upload and readback memcpys
+        uint64_t stagedBatches = 0;
+        uint64_t copiedBytes = 0;
+        double copySeconds = 0.0;
+        // Import path, importSeconds covers registerHostMemory
+        uint64_t importedBatches = 0;
+        uint64_t importedBytes = 0;
+        double importSeconds = 0.0;
+    };
+    const IngestionStats& getIngestionStats() const { return m_ingestionStats; }
 
 private:
-    void setup();
-    void runCompute();
+    // The benchmark executable measures internals such as bare submits and copies
+    friend class Benchmark;
+    // Builds its own pipelines and buffers on this device
+    friend class ComputeGraph;
+
+    // Per in-flight batch resources, indexed by the SubmissionRing slot
+    struct Frame
+    {
+        Buffer dataBuffer;
+        // Only used when dataBuffer is not host-visible
+        Buffer stagingBuffer;
+        uint32_t capacity = 0;
+        // Cached in m_descriptorAllocator, VK_NULL_HANDLE when the binding is pushed instead
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        // What the descriptor currently points at
+        VkBuffer boundBuffer = VK_NULL_HANDLE;
+        VkDeviceSize boundOffset = 0;
+        uint32_t boundElementCount = 0;
+        // Set while the batch runs on registered host memory instead of dataBuffer
+        VkBuffer importedBuffer = VK_NULL_HANDLE;
+
+        // The frame's command buffer still holds a valid recording of this pipeline and element count
+        bool commandsRecorded = false;
+        uint32_t recordedPipelineGeneration = 0;
+        uint32_t recordedElementCount = 0;
+
+        // Pending results, copied out once the submission has finished
+        Calculation* output = nullptr;
+        uint32_t elementCount = 0;
+        SubmitHandle submit;
+#ifdef VK_PROFILE
+        uint64_t submitTimeNs = 0;
+#endif
+    };
+
+    void recordCompute(Frame& frame, uint32_t slot);
+    void recordTransfers(Frame& frame, VkCommandBuffer uploadCommandBuffer, VkCommandBuffer downloadCommandBuffer);
+    bool usesTransferQueue(const Frame& frame) const;
+    void getDispatchSize(uint32_t elementCount, uint32_t& groupCountX, uint32_t& groupCountY) const;
+    bool isRecordingValid(const Frame& frame) const;
+    void retireFrame(Frame& frame);
 
     void createInstance();
     void findPhysicalDevice();
     void createDevice();
-    void createDataBufferAndDescriptorSet();
+    void createDescriptorSetLayoutAndPool();
+    void createPipelineCache();
     void createComputePipeline();
-    void createCommandBuffer();
+    void destroyComputePipeline();
+    void createSmallBatchResources();
+    bool loadKernelTuning();
+    void autotuneKernel();
+    double timeDispatch(uint32_t elementCount, uint32_t repeatCount);
+    void createFrames();
+    void destroyFrames();
+    void reserveDataBuffer(Frame& frame, uint32_t elementCount);
+    void bindDataBuffer(Frame& frame, VkBuffer buffer, VkDeviceSize offset, uint32_t elementCount);
+    // Binds the frame's buffer to set 0 of m_pipelineLayout, inline with push descriptors
+    void cmdBindDataBuffer(VkCommandBuffer commandBuffer, const Frame& frame);
+    // Forgets every descriptor that points at buffer, before the buffer is destroyed
+    void releaseDescriptors(VkBuffer buffer);
+    bool isDeviceExtensionSupported(const char* extensionName) const;
     uint32_t getComputeQueueFamilyIndex();
+    uint32_t getTransferQueueFamilyIndex(uint32_t computeQueueFamilyIndex);
     uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties);
+    uint32_t findMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred);
+    bool hasUnifiedMemory();
 
-    VkInstance m_instance;
-    VkDebugReportCallbackEXT m_debugReportCallback;
-    VkPhysicalDevice m_physicalDevice;
-    VkDevice m_device;
+    void createMemoryArena();
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, BufferUsage bufferUsage);
+    void destroyBuffer(Buffer& buffer);
 
-    VkPipeline m_pipeline;
-    VkPipelineLayout m_pipelineLayout;
+    VkInstance m_instance = VK_NULL_HANDLE;
+    VkDebugReportCallbackEXT m_debugReportCallback = VK_NULL_HANDLE;
+    VkPhysicalDevice m_physicalDevice;
+    // -1 picks the device with the highest scorePhysicalDevice
+    int32_t m_physicalDeviceIndex = -1;
+    VkPhysicalDeviceProperties m_deviceProperties;
+    VkPhysicalDeviceSubgroupProperties m_subgroupProperties = {};
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+    StorageFeatures m_storageFeatures;
+    // Device-local memory is also host-visible (integrated GPUs, software rasterizers), staging is not needed
+    bool m_unifiedMemory = false;
+    VkDevice m_device = VK_NULL_HANDLE;
 
-    VkCommandPool m_commandPool;
-    VkCommandBuffer m_commandBuffer;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    // Shared by both pipelines, holds the push constant range of pushShader.glsl
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    // Incremented whenever m_pipeline is rebuilt, a destroyed handle value may be reused
+    uint32_t m_pipelineGeneration = 0;
+    PipelineCache m_pipelineCache;
+    ShaderModuleCache m_shaderModuleCache;
+    // Modules of m_pipeline and m_smallBatchPipeline. Replaced only after a rebuild created its
+    // pipelines, so rebuilding with new specialization constants reuses them.
+    std::vector<ShaderModuleRef> m_shaderModules;
 
     VkQueue m_computeQueue;
+    uint32_t m_computeQueueFamilyIndex = 0;
+    // Only set when the device has a transfer family separate from the compute family. Staging
+    // copies then run on it, otherwise they are recorded into the compute command buffer.
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    uint32_t m_transferQueueFamilyIndex = 0;
+
+    MemoryArena m_memoryArena;
+    HostMemoryImporter m_hostMemoryImporter;
+    IngestionStats m_ingestionStats;
+
+    SubmissionRing m_submissionRing;
+    std::vector<Frame> m_frames;
+    uint32_t m_framesInFlight = 2;
+    const uint32_t m_maxFramesInFlight = 8;
+    // Resubmit a frame's last recording when nothing it references has changed
+    bool m_reuseRecordedCommands = true;
 
-    VkBuffer m_buffer;
-    VkDeviceMemory m_bufferMemory;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    DescriptorAllocator m_descriptorAllocator;
+    // With VK_KHR_push_descriptor m_descriptorSetLayout is a push descriptor layout, bindings are
+    // written into the command buffer and no set is allocated from it
+    PFN_vkCmdPushDescriptorSetKHR m_cmdPushDescriptorSet = nullptr;
 
-    VkDescriptorPool m_descriptorPool;
-    VkDescriptorSet m_descriptorSet;
-    VkDescriptorSetLayout m_descriptorSetLayout;
+    // Push constant layout of pushShader.glsl
+    struct SmallBatchConstants
+    {
+        uint32_t count;
+        uint32_t padding;
+        float operands[maxSmallBatchSize][2];
+    };
+    static_assert(offsetof(SmallBatchConstants, operands) ==
+                  BufferLayout::Struct<BufferLayout::Rule::Std430, uint32_t, BufferLayout::Vec<float, 2>>::offset(1),
+                  "SmallBatchConstants::operands is not at the offset of the vec2 array in pushShader.glsl");
+
+    // computeSmallBatch has its own command buffer and a results buffer bound once, so it
+    // never disturbs the frames' recordings
+    VkPipeline m_smallBatchPipeline = VK_NULL_HANDLE;
+    SubmissionRing m_smallBatchRing;
+    Buffer m_smallBatchResults;
+    VkDescriptorSet m_smallBatchDescriptorSet = VK_NULL_HANDLE;
 
+#ifdef VK_PROFILE
+    // Two timestamps around the dispatch per frame, VK_NULL_HANDLE if the queue has no timestamp support
+    VkQueryPool m_timestampQueryPool = VK_NULL_HANDLE;
+    uint32_t m_timestampValidBits = 0;
+#endif
 
+    // Specialization constants of compShader.glsl
+    static const uint32_t defaultWorkgroupSize = 256;
+    uint32_t m_workgroupSize = defaultWorkgroupSize;
+    uint32_t m_elementsPerInvocation = 1;
+    bool m_autotune = true;
+    TuningCache m_tuningCache{ "kernel_tuning.txt" };
 
 #ifdef VK_DEBUG
     const bool m_enableValidationLayers = true;
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+
+#include "MemoryArena.h"
+
+// How a buffer is accessed, used to pick its memory type from the heaps the device reports
+enum class BufferUsage
+{
+    GpuOnly,    // Working data read and written by shaders
+    Staging,    // Host-written uploads and host-read readbacks
+    Readback,   // Small results the shader writes straight into host memory, no copy
+};
+
+struct Buffer
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    Allocation allocation;
+    VkDeviceSize size = 0;
+    // Persistently mapped, see allocation.mapped
+    bool hostVisible = false;
+};
+
+// Typed view of a persistently mapped buffer. Writes to non-coherent memory still need
+// MemoryArena::flush before the device reads them, and reads need MemoryArena::invalidate.
+template<typename T>
+class MappedSpan
+{
+public:
+    MappedSpan(T* data, size_t size) : m_data(data), m_size(size) {}
+
+    T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    size_t sizeBytes() const { return m_size * sizeof(T); }
+
+    T& operator[](size_t index) const { return m_data[index]; }
+    T* begin() const { return m_data; }
+    T* end() const { return m_data + m_size; }
+
+private:
+    T* m_data;
+    size_t m_size;
+};
+
+template<typename T>
+MappedSpan<T> mappedSpan(const Buffer& buffer)
+{
+    return MappedSpan<T>(static_cast<T*>(buffer.allocation.mapped), buffer.allocation.mapped ? buffer.size / sizeof(T) : 0);
+}
@@ -0,0 +1,94 @@
+#include "BufferLayout.h"
+
+#include <cstring>
+
+namespace BufferLayout
+{
+    Half::Half(float value)
+    {
+        uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        uint32_t sign = (f >> 16) & 0x8000;
+        uint32_t exponent = (f >> 23) & 0xff;
+        uint32_t mantissa = f & 0x7fffff;
+
+        if (exponent == 0xff)
+        {
+            // Infinity stays infinity, NaN stays a quiet NaN
+            bits = static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+            return;
+        }
+
+        int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+        if (halfExponent >= 31)
+        {
+            bits = static_cast<uint16_t>(sign | 0x7c00);
+            return;
+        }
+
+        uint32_t halfBits;
+        uint32_t dropped;
+        uint32_t droppedCount;
+        if (halfExponent <= 0)
+        {
+            // Subnormal or zero, the implicit leading one becomes explicit
+            if (halfExponent < -10)
+            {
+                bits = static_cast<uint16_t>(sign);
+                return;
+            }
+            mantissa |= 0x800000;
+            droppedCount = static_cast<uint32_t>(14 - halfExponent);
+            halfBits = mantissa >> droppedCount;
+            dropped = mantissa & ((1u << droppedCount) - 1);
+        }
+        else
+        {
+            droppedCount = 13;
+            halfBits = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+            dropped = mantissa & 0x1fff;
+        }
+
+        // Round to nearest even, a carry into the exponent is still the right encoding
+        uint32_t halfway = 1u << (droppedCount - 1);
+        if (dropped > halfway || (dropped == halfway && (halfBits & 1)))
+            ++halfBits;
+        bits = static_cast<uint16_t>(sign | halfBits);
+    }
+
+    Half::operator float() const
+    {
+        uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+        uint32_t exponent = (bits >> 10) & 0x1f;
+        uint32_t mantissa = bits & 0x3ff;
+
+        uint32_t f;
+        if (exponent == 0x1f)
+        {
+            f = sign | 0x7f800000 | (mantissa << 13);
+        }
+        else if (exponent != 0)
+        {
+            f = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0)
+        {
+            f = sign;
+        }
+        else
+        {
+            // Subnormal, normalize it
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            f = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+
+        float value;
+        std::memcpy(&value, &f, sizeof(value));
+        return value;
+    }
+}
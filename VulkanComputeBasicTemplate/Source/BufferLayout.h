@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Host mirrors of shader buffer element types, and the offsets the std430 and scalar block layout
+// rules give their members. A host struct declared as a buffer element with BUFFER_ELEMENT is
+// checked against the layout of its shader declaration at compile time.
+namespace BufferLayout
+{
+    enum class Rule
+    {
+        Std430,     // layout(std430), vec3 and vec4 align to four components
+        Scalar,     // layout(scalar), needs scalarBlockLayout. Every member aligns to its component.
+    };
+
+    // float16_t in shaders, needs storageBuffer16BitAccess. Conversions round to nearest even.
+    struct Half
+    {
+        uint16_t bits;
+
+        Half() = default;
+        explicit Half(float value);
+        explicit operator float() const;
+    };
+
+    // vecN, ivecN, f16vecN, i8vecN and so on, tightly packed. std430 host structs pad vec3 themselves.
+    template<typename T, size_t N>
+    struct Vec
+    {
+        T v[N];
+
+        T& operator[](size_t index) { return v[index]; }
+        const T& operator[](size_t index) const { return v[index]; }
+    };
+
+    template<typename T>
+    struct Component
+    {
+        static_assert(std::is_same<T, float>::value || std::is_same<T, int32_t>::value || std::is_same<T, uint32_t>::value ||
+                      std::is_same<T, Half>::value || std::is_same<T, int16_t>::value || std::is_same<T, uint16_t>::value ||
+                      std::is_same<T, int8_t>::value || std::is_same<T, uint8_t>::value,
+                      "Not a shader buffer component type");
+        static constexpr size_t size = sizeof(T);
+        static constexpr size_t count = 1;
+    };
+
+    template<typename T, size_t N>
+    struct Component<Vec<T, N>>
+    {
+        static_assert(N >= 2 && N <= 4, "Shader vectors have 2 to 4 components");
+        static constexpr size_t size = Component<T>::size;
+        static constexpr size_t count = N;
+    };
+
+    template<Rule rule, typename T>
+    constexpr size_t alignmentOf()
+    {
+        return rule == Rule::Scalar ? Component<T>::size
+                                    : Component<T>::size * (Component<T>::count == 3 ? 4 : Component<T>::count);
+    }
+
+    template<typename T>
+    constexpr size_t sizeOf()
+    {
+        return Component<T>::size * Component<T>::count;
+    }
+
+    constexpr size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    template<Rule rule, typename... Members>
+    constexpr size_t memberOffset(size_t index)
+    {
+        const size_t alignments[] = { alignmentOf<rule, Members>()... };
+        const size_t sizes[] = { sizeOf<Members>()... };
+        size_t end = 0;
+        for (size_t i = 0;; ++i)
+        {
+            size_t start = alignUp(end, alignments[i]);
+            if (i == index)
+                return start;
+            end = start + sizes[i];
+        }
+    }
+
+    template<typename... Members>
+    constexpr size_t lastMemberSize()
+    {
+        const size_t sizes[] = { sizeOf<Members>()... };
+        return sizes[sizeof...(Members) - 1];
+    }
+
+    // A struct of scalar and vector members in declaration order. Arrays of it are strided by
+    // arrayStride, which is also the size the host struct must have.
+    template<Rule layoutRule, typename... Members>
+    struct Struct
+    {
+        static_assert(sizeof...(Members) > 0, "Empty structs are not allowed in shader buffers");
+
+        static constexpr Rule rule = layoutRule;
+        static constexpr size_t memberCount = sizeof...(Members);
+        static constexpr size_t alignment = std::max({ alignmentOf<layoutRule, Members>()... });
+        static constexpr size_t arrayStride =
+            alignUp(memberOffset<layoutRule, Members...>(memberCount - 1) + lastMemberSize<Members...>(), alignment);
+        static constexpr bool needs16BitStorage = ((Component<Members>::size == 2) || ...);
+        static constexpr bool needs8BitStorage = ((Component<Members>::size == 1) || ...);
+
+        static constexpr size_t offset(size_t index) { return memberOffset<layoutRule, Members...>(index); }
+    };
+
+    // How a host type is laid out in a buffer, specialized for structs by BUFFER_ELEMENT. Runtime
+    // arrays of a plain component or vector use the layout of a struct with that single member.
+    template<typename T>
+    struct Element
+    {
+        typedef Struct<Rule::Std430, T> Layout;
+        static_assert(sizeof(T) == Layout::arrayStride, "Host type is not laid out like the shader type");
+    };
+}
+
+// Declares Host as a buffer element laid out like BufferLayout::Struct Layout and checks its size.
+// Check the members with BUFFER_ELEMENT_MEMBER, in the global namespace.
+#define BUFFER_ELEMENT(Host, ...) \
+    template<> struct BufferLayout::Element<Host> \
+    { \
+        typedef BufferLayout::Struct<__VA_ARGS__> Layout; \
+        static_assert(sizeof(Host) == Layout::arrayStride, #Host " does not have the array stride of its shader layout"); \
+    }
+
+#define BUFFER_ELEMENT_MEMBER(Host, member, index) \
+    static_assert(offsetof(Host, member) == BufferLayout::Element<Host>::Layout::offset(index), \
+                  #Host "::" #member " is not at the offset of shader member " #index)
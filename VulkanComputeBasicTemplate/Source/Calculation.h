@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+#include "BufferLayout.h"
+
+// One element of a batch, res = f1 + f2
+struct Calculation
+{
+    float f1, f2, res;
+};
+
+// Must match the std430 array in compShader.glsl
+BUFFER_ELEMENT(Calculation, BufferLayout::Rule::Std430, float, float, float);
+BUFFER_ELEMENT_MEMBER(Calculation, f1, 0);
+BUFFER_ELEMENT_MEMBER(Calculation, f2, 1);
+BUFFER_ELEMENT_MEMBER(Calculation, res, 2);
@@ -0,0 +1,69 @@
+#include "ComputeBackend.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+const uint32_t ComputeBackend::maxSmallBatchSize;
+
+BatchHandle ComputeBackend::computeBatchAsync(std::vector<Calculation>& calculations)
+{
+    return computeBatchAsync(calculations.data(), static_cast<uint32_t>(calculations.size()));
+}
+
+void ComputeBackend::computeBatch(std::vector<Calculation>& calculations)
+{
+    waitBatch(computeBatchAsync(calculations));
+}
+
+void ComputeBackend::Run(uint32_t elementCount)
+{
+    auto setupStart = std::chrono::high_resolution_clock::now();
+    setup();
+    auto setupEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "Setup: " << std::chrono::duration<double, std::milli>(setupEnd - setupStart).count() << " ms" << std::endl;
+
+    std::vector<Calculation> calculations(elementCount);
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        calculations[i].f1 = 3.14f + (float)(i % 1024);
+        calculations[i].f2 = 8.43f * (float)(i % 7);
+        calculations[i].res = 0.f;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    computeBatch(calculations);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    // The small batch path on the first few inputs
+    std::vector<Calculation> smallBatch(calculations.begin(), calculations.begin() + std::min(elementCount, maxSmallBatchSize));
+    for (Calculation& calc : smallBatch)
+        calc.res = 0.f;
+    computeSmallBatch(smallBatch.data(), static_cast<uint32_t>(smallBatch.size()));
+
+    uint32_t mismatches = 0;
+    for (const std::vector<Calculation>* results : { &calculations, &smallBatch })
+    {
+        for (const Calculation& calc : *results)
+        {
+            if (std::fabs(calc.res - (calc.f1 + calc.f2)) > 1e-5f * std::fabs(calc.f1 + calc.f2))
+                ++mismatches;
+        }
+    }
+
+    std::cout << "Device: " << getName() << std::endl;
+    std::cout << "Elements: " << elementCount << ", mismatches: " << mismatches << std::endl;
+    if (elementCount > 0)
+        std::cout << "Result[0]: " << calculations[0].res << std::endl;
+    std::cout << "Batch time: " << seconds * 1000.0 << " ms, "
+              << (seconds > 0.0 ? elementCount / seconds : 0.0) << " elements/sec" << std::endl;
+
+    shutdown();
+
+    if (mismatches > 0)
+        throw std::runtime_error("Results do not match the scalar reference");
+}
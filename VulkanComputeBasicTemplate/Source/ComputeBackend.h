@@ -0,0 +1,46 @@
+#pragma once
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Calculation.h"
+#include "SubmissionRing.h"
+
+// Returned by computeBatchAsync, pass to waitBatch to collect the results
+struct BatchHandle
+{
+    SubmitHandle submit;
+};
+
+// The job API shared by the Vulkan backend (Application) and the CPU fallback (CpuBackend)
+class ComputeBackend
+{
+public:
+    virtual ~ComputeBackend() = default;
+
+    // Sets up, runs one batch of elementCount calculations, checks it against a scalar reference and shuts down
+    void Run(uint32_t elementCount);
+
+    virtual void setup() = 0;
+    virtual void shutdown() = 0;
+    virtual std::string getName() const = 0;
+
+    // Starts computing without waiting. The results are written back into calculations by waitBatch,
+    // or earlier, so the array must stay alive until then.
+    virtual BatchHandle computeBatchAsync(Calculation* calculations, uint32_t elementCount) = 0;
+    virtual bool isBatchComplete(const BatchHandle& batch) const = 0;
+    virtual void waitBatch(const BatchHandle& batch) = 0;
+    // Largest elementCount computeBatchAsync accepts, known after setup
+    virtual uint32_t getMaxBatchSize() const { return std::numeric_limits<uint32_t>::max(); }
+
+    // For up to maxSmallBatchSize calculations where latency matters more than throughput,
+    // larger batches take the computeBatch path
+    virtual void computeSmallBatch(Calculation* calculations, uint32_t elementCount) = 0;
+    // The operands of this many calculations fill the guaranteed 128 bytes of push constants
+    static const uint32_t maxSmallBatchSize = 15;
+
+    BatchHandle computeBatchAsync(std::vector<Calculation>& calculations);
+    // Computes all calculations and writes the results back into res
+    void computeBatch(std::vector<Calculation>& calculations);
+};
@@ -0,0 +1,145 @@
+#include "ComputeClient.h"
+
+#include <stdexcept>
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#include "ComputeServer.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+ComputeClient::ComputeClient(const std::string& socketPath, uint32_t capacity)
+{
+    throw std::runtime_error("The compute client needs Unix domain sockets, which are not supported on Windows");
+}
+
+ComputeClient::~ComputeClient() {}
+void ComputeClient::compute(uint32_t elementCount, uint64_t firstElement) {}
+bool ComputeClient::requestShutdown(const std::string& socketPath) { return false; }
+
+#else
+
+// Anonymous shared memory, nothing is left in the file system if the process dies. On Linux the
+// memfd is sealed against shrinking, the server only maps regions that cannot lose pages under it.
+static int createSharedMemory(size_t size)
+{
+#ifdef __linux__
+    int fileDescriptor = memfd_create("vulkan_compute_jobs", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    static std::atomic<uint32_t> regionCount{ 0 };
+    std::string name = "/vulkan_compute_" + std::to_string(getpid()) + "_" + std::to_string(regionCount++);
+    int fileDescriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fileDescriptor >= 0)
+        shm_unlink(name.c_str());
+#endif
+    if (fileDescriptor < 0)
+        throw std::runtime_error("Failed to create shared memory for the compute client");
+    if (ftruncate(fileDescriptor, static_cast<off_t>(size)) != 0)
+    {
+        ::close(fileDescriptor);
+        throw std::runtime_error("Failed to size the shared memory of the compute client");
+    }
+#ifdef __linux__
+    if (fcntl(fileDescriptor, F_ADD_SEALS, F_SEAL_SHRINK) != 0)
+    {
+        ::close(fileDescriptor);
+        throw std::runtime_error("Failed to seal the shared memory of the compute client");
+    }
+#endif
+    return fileDescriptor;
+}
+
+ComputeClient::ComputeClient(const std::string& socketPath, uint32_t capacity)
+    : m_capacity(capacity)
+{
+    if (capacity == 0)
+        throw std::runtime_error("Compute client needs room for at least one Calculation");
+
+    // Whole pages, the server maps the region as it is
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    m_size = (sizeof(Calculation) * static_cast<size_t>(capacity) + pageSize - 1) / pageSize * pageSize;
+
+    m_socket = ServerProtocol::connect(socketPath);
+    if (m_socket < 0)
+        throw std::runtime_error("No compute server is listening on " + socketPath);
+
+    int fileDescriptor = -1;
+    try
+    {
+        fileDescriptor = createSharedMemory(m_size);
+        void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Failed to map the shared memory of the compute client");
+        m_data = static_cast<Calculation*>(data);
+
+        ServerProtocol::Request request = { ServerProtocol::Attach, 0, m_size };
+        ServerProtocol::Response response;
+        if (!ServerProtocol::sendMessage(m_socket, &request, sizeof(request), fileDescriptor) ||
+            !ServerProtocol::receiveMessage(m_socket, &response, sizeof(response)) || response.status != 0)
+            throw std::runtime_error("The compute server did not accept the shared memory");
+    }
+    catch (...)
+    {
+        if (fileDescriptor >= 0)
+            ::close(fileDescriptor);
+        close();
+        throw;
+    }
+    // The server holds its own mapping now
+    ::close(fileDescriptor);
+}
+
+ComputeClient::~ComputeClient()
+{
+    close();
+}
+
+void ComputeClient::close()
+{
+    if (m_data != nullptr)
+        munmap(m_data, m_size);
+    m_data = nullptr;
+    if (m_socket >= 0)
+        ::close(m_socket);
+    m_socket = -1;
+}
+
+void ComputeClient::compute(uint32_t elementCount, uint64_t firstElement)
+{
+    if (firstElement > m_capacity || elementCount > m_capacity - firstElement)
+        throw std::runtime_error("Job exceeds the compute client's shared memory");
+
+    ServerProtocol::Request request = { ServerProtocol::Compute, elementCount, firstElement };
+    ServerProtocol::Response response;
+    if (!ServerProtocol::sendMessage(m_socket, &request, sizeof(request)) ||
+        !ServerProtocol::receiveMessage(m_socket, &response, sizeof(response)))
+        throw std::runtime_error("Lost the connection to the compute server");
+    if (response.status != 0)
+        throw std::runtime_error(std::string("The compute server did not compute the job: ") + strerror(response.status));
+}
+
+bool ComputeClient::requestShutdown(const std::string& socketPath)
+{
+    int socket = ServerProtocol::connect(socketPath);
+    if (socket < 0)
+        return false;
+
+    // The server closes the connection once it has read the request
+    ServerProtocol::Request request = { ServerProtocol::Shutdown, 0, 0 };
+    bool sent = ServerProtocol::sendMessage(socket, &request, sizeof(request));
+    char end;
+    while (sent && read(socket, &end, 1) > 0)
+        ;
+    ::close(socket);
+    return sent;
+}
+
+#endif
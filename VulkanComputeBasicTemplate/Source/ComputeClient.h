@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Calculation.h"
+
+// One connection to a ComputeServer, see ServerProtocol. The Calculations live in memory shared
+// with the server, so a job sends only its range over the socket. Use from one thread at a time,
+// open several clients for concurrent jobs.
+class ComputeClient
+{
+public:
+    // Connects to the server at socketPath and shares room for capacity Calculations with it
+    ComputeClient(const std::string& socketPath, uint32_t capacity);
+    ~ComputeClient();
+
+    ComputeClient(const ComputeClient&) = delete;
+    ComputeClient& operator=(const ComputeClient&) = delete;
+
+    Calculation* data() const { return m_data; }
+    uint32_t getCapacity() const { return m_capacity; }
+
+    // Computes elementCount Calculations of data() from firstElement on the server. res is filled
+    // in when it returns.
+    void compute(uint32_t elementCount, uint64_t firstElement = 0);
+
+    // Asks the server at socketPath to exit, false if none is listening
+    static bool requestShutdown(const std::string& socketPath);
+
+private:
+    void close();
+
+    int m_socket = -1;
+    Calculation* m_data = nullptr;
+    size_t m_size = 0;
+    uint32_t m_capacity = 0;
+};
@@ -0,0 +1,603 @@
+#include "ComputeGraph.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <set>
+
+#include "Application.h"
+#include "PipelineBuilder.h"
+#include "ShaderLoader.h"
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+ComputeGraph::BufferId ComputeGraph::addBuffer(const std::string& name, VkDeviceSize size, BufferKind kind, void* hostData)
+{
+    if (kind != BufferKind::Transient && hostData == nullptr)
+        throw std::runtime_error("Graph buffer " + name + " needs host data");
+
+    BufferDesc desc;
+    desc.name = name;
+    desc.size = size;
+    desc.kind = kind;
+    desc.hostData = hostData;
+    m_buffers.push_back(desc);
+    m_compiled = false;
+    return static_cast<BufferId>(m_buffers.size() - 1);
+}
+
+void ComputeGraph::requireStorage(const std::string& name, bool storage16Bit, bool storage8Bit, BufferLayout::Rule rule) const
+{
+    const Application::StorageFeatures& features = m_app.getStorageFeatures();
+    if (storage16Bit && !features.storage16Bit)
+        throw std::runtime_error("Graph buffer " + name + " needs 16-bit storage, which the device does not support");
+    if (storage8Bit && !features.storage8Bit)
+        throw std::runtime_error("Graph buffer " + name + " needs 8-bit storage, which the device does not support");
+    if (rule == BufferLayout::Rule::Scalar && !features.scalarBlockLayout)
+        throw std::runtime_error("Graph buffer " + name + " needs the scalar block layout, which the device does not support");
+}
+
+void ComputeGraph::addStage(const std::string& shaderFile, const std::vector<Binding>& bindings, uint32_t groupCountX,
+                            uint32_t groupCountY, uint32_t groupCountZ)
+{
+    for (const Binding& binding : bindings)
+    {
+        if (binding.buffer >= m_buffers.size())
+            throw std::runtime_error("Graph stage " + shaderFile + " binds an unknown buffer");
+    }
+
+    Stage stage;
+    stage.shaderFile = shaderFile;
+    stage.bindings = bindings;
+    stage.groupCount[0] = groupCountX;
+    stage.groupCount[1] = groupCountY;
+    stage.groupCount[2] = groupCountZ;
+    m_stages.push_back(stage);
+    m_compiled = false;
+}
+
+void ComputeGraph::addIndirectStage(const std::string& shaderFile, const std::vector<Binding>& bindings, BufferId argsBuffer,
+                                    VkDeviceSize argsOffset)
+{
+    if (argsBuffer >= m_buffers.size())
+        throw std::runtime_error("Graph stage " + shaderFile + " reads its dispatch arguments from an unknown buffer");
+    if (argsOffset % 4 != 0 || argsOffset + sizeof(VkDispatchIndirectCommand) > m_buffers[argsBuffer].size)
+        throw std::runtime_error("Graph stage " + shaderFile + " has misplaced dispatch arguments");
+
+    addStage(shaderFile, bindings, 1);
+    m_stages.back().argsBuffer = argsBuffer;
+    m_stages.back().argsOffset = argsOffset;
+}
+
+void ComputeGraph::setShaderOptions(const ShaderLoader::Macros& macros, uint32_t targetVulkanVersion)
+{
+    m_shaderMacros = macros;
+    m_targetVulkanVersion = targetVulkanVersion;
+    m_compiled = false;
+}
+
+void ComputeGraph::compile()
+{
+    PROFILE_SCOPE("ComputeGraph::compile");
+
+    destroy();
+    if (m_stages.empty())
+        throw std::runtime_error("Compute graph has no stages");
+
+    scheduleStages();
+    assignMemory();
+    createStagePipelines();
+    recordCommands();
+    m_compiled = true;
+}
+
+std::vector<ComputeGraph::Binding> ComputeGraph::getAccesses(const Stage& stage)
+{
+    std::vector<Binding> accesses = stage.bindings;
+    if (stage.argsBuffer != UINT32_MAX)
+        accesses.push_back({ stage.argsBuffer, false });
+    return accesses;
+}
+
+void ComputeGraph::scheduleStages()
+{
+    // A stage runs one level after the latest stage it depends on. Reads depend on the last writer,
+    // writes also on every reader since then, so a buffer is not overwritten while still being read.
+    std::vector<uint32_t> lastWriterLevel(m_buffers.size(), 0);
+    std::vector<bool> written(m_buffers.size(), false);
+    std::vector<uint32_t> readersLevel(m_buffers.size(), 0);
+    std::vector<bool> read(m_buffers.size(), false);
+
+    for (BufferDesc& buffer : m_buffers)
+    {
+        buffer.firstLevel = UINT32_MAX;
+        buffer.lastLevel = 0;
+        buffer.physicalBuffer = UINT32_MAX;
+    }
+
+    m_levelCount = 0;
+    for (Stage& stage : m_stages)
+    {
+        std::vector<Binding> accesses = getAccesses(stage);
+        uint32_t level = 0;
+        for (const Binding& binding : accesses)
+        {
+            BufferId id = binding.buffer;
+            if (written[id])
+                level = std::max(level, lastWriterLevel[id] + 1);
+            if (binding.write && read[id])
+                level = std::max(level, readersLevel[id] + 1);
+            if (!binding.write && !written[id] && m_buffers[id].kind == BufferKind::Transient)
+                throw std::runtime_error("Graph stage " + stage.shaderFile + " reads " + m_buffers[id].name + " before it is written");
+        }
+        stage.level = level;
+
+        for (const Binding& binding : accesses)
+        {
+            BufferId id = binding.buffer;
+            if (binding.write)
+            {
+                lastWriterLevel[id] = level;
+                written[id] = true;
+                read[id] = false;
+                readersLevel[id] = 0;
+            }
+            else
+            {
+                readersLevel[id] = read[id] ? std::max(readersLevel[id], level) : level;
+                read[id] = true;
+            }
+
+            BufferDesc& buffer = m_buffers[id];
+            buffer.firstLevel = std::min(buffer.firstLevel, level);
+            buffer.lastLevel = std::max(buffer.lastLevel, level);
+        }
+
+        m_levelCount = std::max(m_levelCount, level + 1);
+    }
+
+    // Recorded level by level, stages of one level keep their insertion order
+    std::stable_sort(m_stages.begin(), m_stages.end(),
+                     [](const Stage& a, const Stage& b) { return a.level < b.level; });
+}
+
+void ComputeGraph::assignMemory()
+{
+    const VkPhysicalDeviceProperties& properties = m_app.getDeviceProperties();
+
+    std::vector<BufferId> transients;
+    for (BufferId id = 0; id < m_buffers.size(); ++id)
+    {
+        BufferDesc& buffer = m_buffers[id];
+        if (buffer.size > properties.limits.maxStorageBufferRange)
+            throw std::runtime_error("Graph buffer " + buffer.name + " exceeds maxStorageBufferRange");
+        // Unused buffers get no memory
+        if (buffer.firstLevel == UINT32_MAX)
+            continue;
+
+        if (buffer.kind == BufferKind::Transient)
+        {
+            transients.push_back(id);
+            continue;
+        }
+
+        PhysicalBuffer physical;
+        physical.size = buffer.size;
+        buffer.physicalBuffer = static_cast<uint32_t>(m_physicalBuffers.size());
+        m_physicalBuffers.push_back(physical);
+    }
+
+    // Transients take over a buffer whose last user ran in an earlier level. The barrier between
+    // the levels orders the old reads before the new writes, so no extra barrier is needed.
+    // Among the free buffers the smallest one that fits is taken, otherwise the largest one grows.
+    std::stable_sort(transients.begin(), transients.end(),
+                     [this](BufferId a, BufferId b) { return m_buffers[a].firstLevel < m_buffers[b].firstLevel; });
+
+    size_t firstTransient = m_physicalBuffers.size();
+    for (BufferId id : transients)
+    {
+        BufferDesc& buffer = m_buffers[id];
+
+        uint32_t best = UINT32_MAX;
+        for (size_t i = firstTransient; i < m_physicalBuffers.size(); ++i)
+        {
+            const PhysicalBuffer& candidate = m_physicalBuffers[i];
+            if (candidate.lastLevel >= buffer.firstLevel)
+                continue;
+            if (best == UINT32_MAX)
+            {
+                best = static_cast<uint32_t>(i);
+                continue;
+            }
+
+            const PhysicalBuffer& current = m_physicalBuffers[best];
+            bool candidateFits = candidate.size >= buffer.size;
+            bool currentFits = current.size >= buffer.size;
+            if ((candidateFits && (!currentFits || candidate.size < current.size)) ||
+                (!candidateFits && !currentFits && candidate.size > current.size))
+                best = static_cast<uint32_t>(i);
+        }
+
+        if (best == UINT32_MAX)
+        {
+            best = static_cast<uint32_t>(m_physicalBuffers.size());
+            m_physicalBuffers.push_back(PhysicalBuffer());
+        }
+
+        PhysicalBuffer& physical = m_physicalBuffers[best];
+        physical.size = std::max(physical.size, buffer.size);
+        physical.lastLevel = buffer.lastLevel;
+        buffer.physicalBuffer = best;
+    }
+
+    std::vector<bool> needsStaging(m_physicalBuffers.size(), false);
+    for (const BufferDesc& buffer : m_buffers)
+    {
+        if (buffer.physicalBuffer != UINT32_MAX && buffer.kind != BufferKind::Transient)
+            needsStaging[buffer.physicalBuffer] = true;
+    }
+    std::vector<bool> holdsArgs(m_physicalBuffers.size(), false);
+    for (const Stage& stage : m_stages)
+    {
+        if (stage.argsBuffer != UINT32_MAX)
+            holdsArgs[m_buffers[stage.argsBuffer].physicalBuffer] = true;
+    }
+
+    for (size_t i = 0; i < m_physicalBuffers.size(); ++i)
+    {
+        PhysicalBuffer& physical = m_physicalBuffers[i];
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        if (holdsArgs[i])
+            usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        physical.buffer = m_app.createBuffer(physical.size, usage, BufferUsage::GpuOnly);
+        if (needsStaging[i] && !physical.buffer.hostVisible)
+        {
+            physical.stagingBuffer = m_app.createBuffer(physical.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                        BufferUsage::Staging);
+        }
+    }
+}
+
+uint32_t ComputeGraph::getPipeline(const std::string& shaderFile, uint32_t bindingCount)
+{
+    for (uint32_t i = 0; i < m_pipelines.size(); ++i)
+    {
+        if (m_pipelines[i].shaderFile == shaderFile && m_pipelines[i].bindingCount == bindingCount)
+            return i;
+    }
+
+    VkDevice device = m_app.m_device;
+
+    Pipeline pipeline;
+    pipeline.shaderFile = shaderFile;
+    pipeline.bindingCount = bindingCount;
+
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; ++i)
+    {
+        layoutBindings[i] = {};
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = bindingCount;
+    layoutCreateInfo.pBindings = layoutBindings.data();
+    CHECK_VK_RESULT(vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &pipeline.descriptorSetLayout),
+                    "Failed to create graph descriptor set layout");
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &pipeline.descriptorSetLayout;
+    CHECK_VK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipeline.pipelineLayout),
+                    "Failed to create graph pipeline layout");
+
+    m_pipelines.push_back(pipeline);
+    return static_cast<uint32_t>(m_pipelines.size() - 1);
+}
+
+void ComputeGraph::createStagePipelines()
+{
+    VkDevice device = m_app.m_device;
+    const VkPhysicalDeviceLimits& limits = m_app.getDeviceProperties().limits;
+
+    uint32_t descriptorCount = 0;
+    for (Stage& stage : m_stages)
+    {
+        for (uint32_t i = 0; i < 3 && stage.argsBuffer == UINT32_MAX; ++i)
+        {
+            if (stage.groupCount[i] == 0 || stage.groupCount[i] > limits.maxComputeWorkGroupCount[i])
+                throw std::runtime_error("Graph stage " + stage.shaderFile + " exceeds maxComputeWorkGroupCount");
+        }
+
+        stage.pipelineIndex = getPipeline(stage.shaderFile, static_cast<uint32_t>(stage.bindings.size()));
+        descriptorCount += static_cast<uint32_t>(stage.bindings.size());
+    }
+
+    // The layouts exist now, the shaders of all stages compile in parallel
+    std::vector<PipelineBuilder::ComputePipelineDesc> descs(m_pipelines.size());
+    for (size_t i = 0; i < m_pipelines.size(); ++i)
+    {
+        const std::string& shaderFile = m_pipelines[i].shaderFile;
+        descs[i].shader = { shaderFile, shaderFile.substr(shaderFile.find_last_of("/\\") + 1), VK_SHADER_STAGE_COMPUTE_BIT,
+                            m_shaderMacros, m_targetVulkanVersion };
+        descs[i].layout = m_pipelines[i].pipelineLayout;
+    }
+    std::vector<ShaderModuleRef> shaderModules;
+    std::vector<VkPipeline> pipelines = PipelineBuilder::createComputePipelines(m_app.m_shaderModuleCache, m_app.m_pipelineCache.get(), descs,
+                                                                                ShaderLoader::getCompilePool(),
+                                                                                PipelineBuilder::Mode::PerThread, &shaderModules);
+    for (size_t i = 0; i < m_pipelines.size(); ++i)
+    {
+        m_pipelines[i].pipeline = pipelines[i];
+        m_pipelines[i].shaderModule = shaderModules[i];
+    }
+
+    // One set per stage, stages sharing a pipeline still bind different buffers
+    VkDescriptorPoolSize descriptorPoolSize = {};
+    descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorPoolSize.descriptorCount = std::max(descriptorCount, 1u);
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.maxSets = static_cast<uint32_t>(m_stages.size());
+    descriptorPoolCreateInfo.poolSizeCount = 1;
+    descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+    CHECK_VK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &m_descriptorPool),
+                    "Failed to create graph descriptor pool");
+
+    for (Stage& stage : m_stages)
+    {
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_pipelines[stage.pipelineIndex].descriptorSetLayout;
+        CHECK_VK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &stage.descriptorSet),
+                        "Failed to allocate graph descriptor set");
+
+        // The range is the logical size, so length() in the shader ignores the rest of an aliased buffer
+        std::vector<VkDescriptorBufferInfo> bufferInfos(stage.bindings.size());
+        std::vector<VkWriteDescriptorSet> writes(stage.bindings.size());
+        for (uint32_t i = 0; i < stage.bindings.size(); ++i)
+        {
+            const BufferDesc& buffer = m_buffers[stage.bindings[i].buffer];
+            bufferInfos[i].buffer = m_physicalBuffers[buffer.physicalBuffer].buffer.buffer;
+            bufferInfos[i].offset = 0;
+            bufferInfos[i].range = buffer.size;
+
+            writes[i] = {};
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = stage.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+static VkMemoryBarrier memoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+    return barrier;
+}
+
+void ComputeGraph::recordCommands()
+{
+    m_submissionRing.init(m_app.m_device, m_app.m_computeQueue, m_app.m_computeQueueFamilyIndex, 1);
+
+    uint32_t slot = m_submissionRing.acquire();
+    VkCommandBuffer commandBuffer = m_submissionRing.getCommandBuffer(slot);
+
+    // Recorded once and resubmitted by every run
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    // Global memory barriers instead of one buffer barrier per binding, drivers handle them the same
+    // way and a single barrier per level boundary covers every buffer of the level
+    m_barrierCount = 0;
+    const VkAccessFlags shaderAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    // Dispatch arguments are read in the draw indirect stage, before the shader runs. The barrier
+    // in front of a level with indirect stages waits for that stage and access too.
+    std::vector<bool> levelReadsArgs(m_levelCount, false);
+    for (const Stage& stage : m_stages)
+        levelReadsArgs[stage.level] = levelReadsArgs[stage.level] || stage.argsBuffer != UINT32_MAX;
+    auto dstStageMask = [&](uint32_t level) -> VkPipelineStageFlags {
+        return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (levelReadsArgs[level] ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT : 0);
+    };
+    auto dstAccessMask = [&](uint32_t level) -> VkAccessFlags {
+        return shaderAccess | (levelReadsArgs[level] ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT : 0);
+    };
+
+    CHECK_VK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo),
+                    "Failed to begin command buffer");
+    {
+        bool uploaded = false;
+        for (const BufferDesc& buffer : m_buffers)
+        {
+            if (buffer.kind != BufferKind::Input || buffer.physicalBuffer == UINT32_MAX)
+                continue;
+            const PhysicalBuffer& physical = m_physicalBuffers[buffer.physicalBuffer];
+            if (physical.stagingBuffer.buffer == VK_NULL_HANDLE)
+                continue;
+
+            VkBufferCopy copyRegion = {};
+            copyRegion.size = buffer.size;
+            vkCmdCopyBuffer(commandBuffer, physical.stagingBuffer.buffer, physical.buffer.buffer, 1, &copyRegion);
+            uploaded = true;
+        }
+
+        if (uploaded)
+        {
+            // Uploaded arguments may be read by an indirect stage of any level
+            bool anyArgs = std::find(levelReadsArgs.begin(), levelReadsArgs.end(), true) != levelReadsArgs.end();
+            VkMemoryBarrier barrier = memoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                    shaderAccess | (anyArgs ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT : 0));
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | (anyArgs ? VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT : 0), 0,
+                                 1, &barrier, 0, nullptr, 0, nullptr);
+            ++m_barrierCount;
+        }
+
+        uint32_t currentLevel = 0;
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        for (const Stage& stage : m_stages)
+        {
+            if (stage.level != currentLevel)
+            {
+                // Covers read-after-write and, since it is also an execution dependency, write-after-read
+                VkMemoryBarrier barrier = memoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, dstAccessMask(stage.level));
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStageMask(stage.level), 0,
+                                     1, &barrier, 0, nullptr, 0, nullptr);
+                ++m_barrierCount;
+                currentLevel = stage.level;
+            }
+
+            const Pipeline& pipeline = m_pipelines[stage.pipelineIndex];
+            if (pipeline.pipeline != boundPipeline)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+                boundPipeline = pipeline.pipeline;
+            }
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipelineLayout, 0, 1,
+                                    &stage.descriptorSet, 0, nullptr);
+            if (stage.argsBuffer != UINT32_MAX)
+            {
+                const BufferDesc& args = m_buffers[stage.argsBuffer];
+                vkCmdDispatchIndirect(commandBuffer, m_physicalBuffers[args.physicalBuffer].buffer.buffer, stage.argsOffset);
+            }
+            else
+            {
+                vkCmdDispatch(commandBuffer, stage.groupCount[0], stage.groupCount[1], stage.groupCount[2]);
+            }
+        }
+
+        bool download = false;
+        for (const BufferDesc& buffer : m_buffers)
+        {
+            if (buffer.kind == BufferKind::Output && buffer.physicalBuffer != UINT32_MAX &&
+                m_physicalBuffers[buffer.physicalBuffer].stagingBuffer.buffer != VK_NULL_HANDLE)
+                download = true;
+        }
+
+        if (download)
+        {
+            VkMemoryBarrier barrier = memoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                                 1, &barrier, 0, nullptr, 0, nullptr);
+            ++m_barrierCount;
+
+            for (const BufferDesc& buffer : m_buffers)
+            {
+                if (buffer.kind != BufferKind::Output || buffer.physicalBuffer == UINT32_MAX)
+                    continue;
+                const PhysicalBuffer& physical = m_physicalBuffers[buffer.physicalBuffer];
+                if (physical.stagingBuffer.buffer == VK_NULL_HANDLE)
+                    continue;
+
+                VkBufferCopy copyRegion = {};
+                copyRegion.size = buffer.size;
+                vkCmdCopyBuffer(commandBuffer, physical.buffer.buffer, physical.stagingBuffer.buffer, 1, &copyRegion);
+            }
+
+            barrier = memoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+            ++m_barrierCount;
+        }
+        else
+        {
+            VkMemoryBarrier barrier = memoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                 1, &barrier, 0, nullptr, 0, nullptr);
+            ++m_barrierCount;
+        }
+    }
+    CHECK_VK_RESULT(vkEndCommandBuffer(commandBuffer),
+                    "Failed to end command buffer");
+}
+
+const Buffer& ComputeGraph::getHostBuffer(const PhysicalBuffer& physical) const
+{
+    return physical.stagingBuffer.buffer != VK_NULL_HANDLE ? physical.stagingBuffer : physical.buffer;
+}
+
+void ComputeGraph::run()
+{
+    PROFILE_SCOPE("ComputeGraph::run");
+
+    if (!m_compiled)
+        compile();
+
+    for (const BufferDesc& buffer : m_buffers)
+    {
+        if (buffer.kind != BufferKind::Input || buffer.physicalBuffer == UINT32_MAX)
+            continue;
+        const Buffer& hostBuffer = getHostBuffer(m_physicalBuffers[buffer.physicalBuffer]);
+        memcpy(hostBuffer.allocation.mapped, buffer.hostData, buffer.size);
+        m_app.m_memoryArena.flush(hostBuffer.allocation, 0, buffer.size);
+    }
+
+    uint32_t slot = m_submissionRing.acquire();
+    SubmitHandle handle = m_submissionRing.submit(slot);
+    m_submissionRing.wait(handle);
+
+    for (const BufferDesc& buffer : m_buffers)
+    {
+        if (buffer.kind != BufferKind::Output || buffer.physicalBuffer == UINT32_MAX)
+            continue;
+        const Buffer& hostBuffer = getHostBuffer(m_physicalBuffers[buffer.physicalBuffer]);
+        m_app.m_memoryArena.invalidate(hostBuffer.allocation, 0, buffer.size);
+        memcpy(buffer.hostData, hostBuffer.allocation.mapped, buffer.size);
+    }
+}
+
+uint32_t ComputeGraph::getTransientAllocationCount() const
+{
+    std::set<uint32_t> physicalBuffers;
+    for (const BufferDesc& buffer : m_buffers)
+    {
+        if (buffer.kind == BufferKind::Transient && buffer.physicalBuffer != UINT32_MAX)
+            physicalBuffers.insert(buffer.physicalBuffer);
+    }
+    return static_cast<uint32_t>(physicalBuffers.size());
+}
+
+void ComputeGraph::destroy()
+{
+    m_submissionRing.destroy();
+
+    VkDevice device = m_app.m_device;
+    if (m_descriptorPool != VK_NULL_HANDLE)
+        vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+    m_descriptorPool = VK_NULL_HANDLE;
+
+    for (Pipeline& pipeline : m_pipelines)
+    {
+        vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipeline.pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(device, pipeline.descriptorSetLayout, nullptr);
+    }
+    m_pipelines.clear();
+
+    for (PhysicalBuffer& physical : m_physicalBuffers)
+    {
+        m_app.destroyBuffer(physical.buffer);
+        m_app.destroyBuffer(physical.stagingBuffer);
+    }
+    m_physicalBuffers.clear();
+
+    for (Stage& stage : m_stages)
+        stage.descriptorSet = VK_NULL_HANDLE;
+    m_compiled = false;
+}
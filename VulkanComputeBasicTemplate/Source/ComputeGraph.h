@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+#include "Buffer.h"
+#include "BufferLayout.h"
+#include "ShaderLoader.h"
+#include "ShaderModuleCache.h"
+#include "SubmissionRing.h"
+
+class Application;
+
+// A DAG of compute stages recorded into one command buffer. Stages are added in program order,
+// the dependencies follow from which buffers each stage reads and writes. Stages without a path
+// between them share a level and run without a barrier in between, levels are separated by a
+// single memory barrier. Transient buffers never leave the device and share memory with other
+// transients whose live ranges do not overlap. Indirect stages take their grid size from a buffer
+// written by an earlier stage, so data-dependent passes need no host round trip.
+class ComputeGraph
+{
+public:
+    typedef uint32_t BufferId;
+
+    enum class BufferKind
+    {
+        Input,      // Uploaded from host memory before every run
+        Output,     // Read back into host memory after every run
+        Transient,  // Only written and read by stages
+    };
+
+    struct Binding
+    {
+        BufferId buffer;
+        bool write;
+    };
+
+    explicit ComputeGraph(Application& app) : m_app(app) {}
+    ~ComputeGraph() { destroy(); }
+
+    ComputeGraph(const ComputeGraph&) = delete;
+    ComputeGraph& operator=(const ComputeGraph&) = delete;
+
+    // hostData of inputs and outputs must stay valid for every run
+    BufferId addBuffer(const std::string& name, VkDeviceSize size, BufferKind kind, void* hostData = nullptr);
+    // count elements of T, laid out as BufferLayout::Element<T> declares. Throws if the device lacks
+    // the 16-bit or 8-bit storage or the scalar block layout that layout needs.
+    template<typename T>
+    BufferId addTypedBuffer(const std::string& name, uint32_t count, BufferKind kind, T* hostData = nullptr)
+    {
+        typedef typename BufferLayout::Element<T>::Layout Layout;
+        requireStorage(name, Layout::needs16BitStorage, Layout::needs8BitStorage, Layout::rule);
+        return addBuffer(name, Layout::arrayStride * static_cast<VkDeviceSize>(count), kind, hostData);
+    }
+    // Binding i of the stage is binding i of the shader, all of them storage buffers in set 0
+    void addStage(const std::string& shaderFile, const std::vector<Binding>& bindings, uint32_t groupCountX,
+                  uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+    // Dispatched with vkCmdDispatchIndirect from the VkDispatchIndirectCommand at argsOffset in
+    // argsBuffer. The writer must keep the group counts within maxComputeWorkGroupCount.
+    void addIndirectStage(const std::string& shaderFile, const std::vector<Binding>& bindings, BufferId argsBuffer,
+                          VkDeviceSize argsOffset = 0);
+
+    // Compile options of every stage's shader, see ShaderLoader::ShaderRequest
+    void setShaderOptions(const ShaderLoader::Macros& macros, uint32_t targetVulkanVersion = 0);
+
+    // Schedules the stages, assigns memory to the buffers, builds the pipelines and records the
+    // command buffer. Must be called again after adding buffers or stages.
+    void compile();
+    // Uploads the inputs, submits the recording and reads back the outputs
+    void run();
+    void destroy();
+
+    uint32_t getLevelCount() const { return m_levelCount; }
+    uint32_t getBarrierCount() const { return m_barrierCount; }
+    // Device buffers actually created for the transients, at most one per transient
+    uint32_t getTransientAllocationCount() const;
+
+private:
+    struct BufferDesc
+    {
+        std::string name;
+        VkDeviceSize size;
+        BufferKind kind;
+        void* hostData;
+
+        // Assigned by compile
+        uint32_t firstLevel = UINT32_MAX;
+        uint32_t lastLevel = 0;
+        uint32_t physicalBuffer = UINT32_MAX;
+    };
+
+    // Device memory behind one or more buffers, plus staging for inputs and outputs
+    struct PhysicalBuffer
+    {
+        VkDeviceSize size = 0;
+        uint32_t lastLevel = 0;
+        Buffer buffer;
+        Buffer stagingBuffer;
+    };
+
+    // Stages running the same shader with the same number of bindings share one
+    struct Pipeline
+    {
+        std::string shaderFile;
+        uint32_t bindingCount = 0;
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        ShaderModuleRef shaderModule;
+    };
+
+    struct Stage
+    {
+        std::string shaderFile;
+        std::vector<Binding> bindings;
+        uint32_t groupCount[3];
+        // UINT32_MAX for a direct dispatch
+        BufferId argsBuffer = UINT32_MAX;
+        VkDeviceSize argsOffset = 0;
+
+        // Assigned by compile
+        uint32_t level = 0;
+        uint32_t pipelineIndex = 0;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    };
+
+    void requireStorage(const std::string& name, bool storage16Bit, bool storage8Bit, BufferLayout::Rule rule) const;
+    // The bindings plus the read of the dispatch arguments
+    static std::vector<Binding> getAccesses(const Stage& stage);
+    void scheduleStages();
+    void assignMemory();
+    // Finds or adds the pipeline's layouts, the pipelines themselves are created together
+    uint32_t getPipeline(const std::string& shaderFile, uint32_t bindingCount);
+    void createStagePipelines();
+    void recordCommands();
+    const Buffer& getHostBuffer(const PhysicalBuffer& physical) const;
+
+    Application& m_app;
+    std::vector<BufferDesc> m_buffers;
+    std::vector<Stage> m_stages;
+    std::vector<PhysicalBuffer> m_physicalBuffers;
+    std::vector<Pipeline> m_pipelines;
+    ShaderLoader::Macros m_shaderMacros;
+    uint32_t m_targetVulkanVersion = 0;
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    SubmissionRing m_submissionRing;
+    bool m_compiled = false;
+    uint32_t m_levelCount = 0;
+    uint32_t m_barrierCount = 0;
+};
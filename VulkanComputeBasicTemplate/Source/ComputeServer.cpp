@@ -0,0 +1,509 @@
+#include "ComputeServer.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+// SCM_RIGHTS and POSIX shared memory have no equivalent here
+ComputeServer::ComputeServer(ComputeBackend& backend, const std::string& socketPath)
+    : m_backend(backend), m_socketPath(socketPath)
+{
+    throw std::runtime_error("The compute server needs Unix domain sockets, which are not supported on Windows");
+}
+
+ComputeServer::~ComputeServer() {}
+void ComputeServer::run() {}
+void ComputeServer::stop() {}
+
+bool ServerProtocol::sendMessage(int, const void*, size_t, int) { return false; }
+bool ServerProtocol::receiveMessage(int, void*, size_t, int*) { return false; }
+int ServerProtocol::connect(const std::string&) { return -1; }
+
+#else
+
+// A closed peer must fail the send, not raise SIGPIPE in the whole process
+#ifdef MSG_NOSIGNAL
+static const int sendFlags = MSG_NOSIGNAL;
+#else
+static const int sendFlags = 0;
+#endif
+
+static void disableSigpipe(int socket)
+{
+#ifdef SO_NOSIGPIPE
+    int enabled = 1;
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#else
+    (void)socket;
+#endif
+}
+
+static sockaddr_un makeAddress(const std::string& path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Invalid socket path: " + path);
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+bool ServerProtocol::sendMessage(int socket, const void* data, size_t size, int fileDescriptor)
+{
+    iovec io = { const_cast<void*>(data), size };
+    msghdr message = {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (fileDescriptor >= 0)
+    {
+        memset(control, 0, sizeof(control));
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &fileDescriptor, sizeof(int));
+    }
+
+    // The descriptor travels with the first part, a short write sends the rest plainly
+    ssize_t sent;
+    do
+        sent = sendmsg(socket, &message, sendFlags);
+    while (sent < 0 && errno == EINTR);
+    if (sent <= 0)
+        return false;
+
+    const char* rest = static_cast<const char*>(data) + sent;
+    size_t left = size - static_cast<size_t>(sent);
+    while (left > 0)
+    {
+        ssize_t written = send(socket, rest, left, sendFlags);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        rest += written;
+        left -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// One recvmsg into data. The first descriptor is stored in received if it is still -1 and the
+// caller keeps descriptors, any other the peer sent is closed.
+static ssize_t receivePart(int socket, void* data, size_t size, bool keepDescriptor, int& received)
+{
+    iovec io = { data, size };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr message = {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t chunk = recvmsg(socket, &message, 0);
+    if (chunk <= 0)
+        return chunk;
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+    {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i)
+        {
+            int descriptor;
+            memcpy(&descriptor, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            if (keepDescriptor && received < 0)
+                received = descriptor;
+            else
+                close(descriptor);
+        }
+    }
+    return chunk;
+}
+
+bool ServerProtocol::receiveMessage(int socket, void* data, size_t size, int* fileDescriptor)
+{
+    int received = -1;
+    char* bytes = static_cast<char*>(data);
+    size_t offset = 0;
+    while (offset < size)
+    {
+        ssize_t chunk = receivePart(socket, bytes + offset, size - offset, fileDescriptor != nullptr, received);
+        if (chunk < 0 && errno == EINTR)
+            continue;
+        if (chunk <= 0)
+        {
+            if (received >= 0)
+                close(received);
+            return false;
+        }
+        offset += static_cast<size_t>(chunk);
+    }
+
+    if (fileDescriptor != nullptr)
+        *fileDescriptor = received;
+    return true;
+}
+
+// On Linux only memfds sealed with F_SEAL_SHRINK. Elsewhere nothing stops a client from truncating
+// its region while attached, which crashes the server, so serve only clients trusted not to.
+static bool cannotShrink(int fileDescriptor)
+{
+#ifdef __linux__
+    int seals = fcntl(fileDescriptor, F_GET_SEALS);
+    return seals >= 0 && (seals & F_SEAL_SHRINK) != 0;
+#else
+    (void)fileDescriptor;
+    return true;
+#endif
+}
+
+int ServerProtocol::connect(const std::string& path)
+{
+    sockaddr_un address = makeAddress(path);
+    int socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket < 0)
+        return -1;
+    if (::connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(socket);
+        return -1;
+    }
+    disableSigpipe(socket);
+    return socket;
+}
+
+ComputeServer::ComputeServer(ComputeBackend& backend, const std::string& socketPath)
+    : m_backend(backend), m_socketPath(socketPath)
+{
+    sockaddr_un address = makeAddress(socketPath);
+
+    // A file nobody listens on is left over from a server that did not exit cleanly
+    int existing = ServerProtocol::connect(socketPath);
+    if (existing >= 0)
+    {
+        close(existing);
+        throw std::runtime_error("A compute server is already listening on " + socketPath);
+    }
+    unlink(socketPath.c_str());
+
+    if (pipe(m_wakePipe) != 0)
+        throw std::runtime_error("Failed to create the server wake-up pipe");
+    fcntl(m_wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(m_wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    m_listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    m_bound = m_listenSocket >= 0 && bind(m_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    if (!m_bound || listen(m_listenSocket, SOMAXCONN) != 0)
+    {
+        int error = errno;
+        closeSockets();
+        throw std::runtime_error("Failed to listen on " + socketPath + ": " + strerror(error));
+    }
+}
+
+ComputeServer::~ComputeServer()
+{
+    closeSockets();
+}
+
+void ComputeServer::closeSockets()
+{
+    for (Client& client : m_clients)
+        closeClient(client);
+    m_clients.clear();
+
+    // Only a bound socket owns the file, it may be another server's otherwise
+    if (m_listenSocket >= 0 && m_bound)
+        unlink(m_socketPath.c_str());
+    if (m_listenSocket >= 0)
+        close(m_listenSocket);
+    m_listenSocket = -1;
+    m_bound = false;
+
+    for (int& end : m_wakePipe)
+    {
+        if (end >= 0)
+            close(end);
+        end = -1;
+    }
+}
+
+void ComputeServer::stop()
+{
+    m_stopRequested = true;
+    char wake = 1;
+    ssize_t written = write(m_wakePipe[1], &wake, 1);
+    (void)written;
+}
+
+void ComputeServer::run()
+{
+    // The backend is set up now, a job it cannot take in one batch is rejected when it arrives
+    m_maxBatchElements = std::max(1u, std::min(m_maxBatchElements, m_backend.getMaxBatchSize()));
+
+    while (!m_stopRequested)
+    {
+        collectRequests(-1);
+
+        if (m_batchWindowMicroseconds > 0)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_batchWindowMicroseconds);
+            auto pending = [this] { return std::any_of(m_clients.begin(), m_clients.end(), [](const Client& client) { return client.pending; }); };
+            while (!m_stopRequested && pending())
+            {
+                auto left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0)
+                    break;
+                collectRequests(static_cast<int>((left + 999) / 1000));
+            }
+        }
+
+        computePending();
+        m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(), [](const Client& client) { return client.socket < 0; }),
+                        m_clients.end());
+    }
+
+    closeSockets();
+}
+
+void ComputeServer::collectRequests(int timeoutMilliseconds)
+{
+    // Clients waiting for a response are not polled, the protocol has one request in flight per connection
+    std::vector<pollfd> descriptors;
+    descriptors.push_back({ m_wakePipe[0], POLLIN, 0 });
+    descriptors.push_back({ m_listenSocket, POLLIN, 0 });
+    for (const Client& client : m_clients)
+        descriptors.push_back({ client.pending ? -1 : client.socket, POLLIN, 0 });
+
+    if (poll(descriptors.data(), descriptors.size(), timeoutMilliseconds) < 0)
+    {
+        if (errno == EINTR)
+            return;
+        throw std::runtime_error("Failed to poll the server sockets");
+    }
+
+    if (descriptors[0].revents != 0)
+    {
+        char drain[64];
+        while (read(m_wakePipe[0], drain, sizeof(drain)) > 0)
+            ;
+    }
+
+    size_t clientCount = m_clients.size();
+    for (size_t i = 0; i < clientCount; ++i)
+    {
+        Client& client = m_clients[i];
+        if ((descriptors[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) && !readRequest(client))
+            closeClient(client);
+    }
+
+    if (descriptors[1].revents & POLLIN)
+        acceptClient();
+}
+
+void ComputeServer::acceptClient()
+{
+    int socket = accept(m_listenSocket, nullptr, nullptr);
+    if (socket < 0)
+        return;
+    disableSigpipe(socket);
+    // A slow or stalled client must not hold up the others, neither while reading nor while responding
+    if (fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        close(socket);
+        return;
+    }
+
+    Client client;
+    client.socket = socket;
+    m_clients.push_back(client);
+    ++m_stats.connections;
+}
+
+bool ComputeServer::readRequest(Client& client)
+{
+    // Whatever part of the request has arrived, the rest comes with a later wakeup. An interrupted
+    // read returns to the loop, which checks for stop.
+    ssize_t chunk = receivePart(client.socket, reinterpret_cast<char*>(&client.request) + client.requestBytes,
+                                sizeof(client.request) - client.requestBytes, true, client.requestDescriptor);
+    if (chunk < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        return true;
+    if (chunk <= 0)
+        return false;
+    client.requestBytes += static_cast<size_t>(chunk);
+    if (client.requestBytes < sizeof(client.request))
+        return true;
+
+    ServerProtocol::Request request = client.request;
+    int fileDescriptor = client.requestDescriptor;
+    client.requestBytes = 0;
+    client.requestDescriptor = -1;
+
+    if (request.type == ServerProtocol::Attach)
+    {
+        // Touching pages past the end of the file raises SIGBUS, so the region must fit in the file and
+        // the file must not shrink later
+        struct stat fileStat;
+        bool valid = fileDescriptor >= 0 && client.region == nullptr && request.value > 0 && cannotShrink(fileDescriptor) &&
+                     fstat(fileDescriptor, &fileStat) == 0 && static_cast<uint64_t>(fileStat.st_size) >= request.value;
+        void* region = valid ? mmap(nullptr, request.value, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0) : MAP_FAILED;
+        if (fileDescriptor >= 0)
+            close(fileDescriptor);
+        if (region == MAP_FAILED)
+            return false;
+
+        client.region = static_cast<char*>(region);
+        client.regionSize = request.value;
+        respond(client, 0, 0);
+        return client.socket >= 0;
+    }
+
+    if (fileDescriptor >= 0)
+        close(fileDescriptor);
+
+    if (request.type == ServerProtocol::Compute)
+    {
+        uint64_t capacity = client.regionSize / sizeof(Calculation);
+        if (client.region == nullptr || request.value > capacity || request.elementCount > capacity - request.value ||
+            request.elementCount > m_maxBatchElements)
+        {
+            respond(client, EINVAL, 0);
+            return client.socket >= 0;
+        }
+        if (request.elementCount == 0)
+        {
+            respond(client, 0, 0);
+            return client.socket >= 0;
+        }
+
+        client.pending = true;
+        client.firstElement = request.value;
+        client.elementCount = request.elementCount;
+        return true;
+    }
+
+    if (request.type == ServerProtocol::Shutdown)
+        stop();
+    return false;
+}
+
+void ComputeServer::computePending()
+{
+    // Jobs join the batch in connection order until the next one would overflow it
+    std::vector<Client*> batch;
+    uint64_t elementCount = 0;
+    for (Client& client : m_clients)
+    {
+        if (!client.pending)
+            continue;
+        if (!batch.empty() && elementCount + client.elementCount > m_maxBatchElements)
+        {
+            computeBatch(batch, elementCount);
+            batch.clear();
+            elementCount = 0;
+        }
+        batch.push_back(&client);
+        elementCount += client.elementCount;
+    }
+    if (!batch.empty())
+        computeBatch(batch, elementCount);
+}
+
+void ComputeServer::computeBatch(const std::vector<Client*>& batch, uint64_t elementCount)
+{
+    ++m_stats.batches;
+    m_stats.jobs += batch.size();
+    m_stats.elements += elementCount;
+    m_stats.peakBatchJobs = std::max(m_stats.peakBatchJobs, static_cast<uint32_t>(batch.size()));
+
+    auto compute = [this](Calculation* calculations, uint32_t count)
+    {
+        if (count <= ComputeBackend::maxSmallBatchSize)
+            m_backend.computeSmallBatch(calculations, count);
+        else
+            m_backend.waitBatch(m_backend.computeBatchAsync(calculations, count));
+    };
+
+    // A failed batch fails its jobs, the server and the other clients carry on
+    int32_t status = 0;
+    try
+    {
+        // A lone job is computed straight from its shared memory, several are gathered first
+        if (batch.size() == 1)
+        {
+            Client& client = *batch[0];
+            compute(reinterpret_cast<Calculation*>(client.region) + client.firstElement, client.elementCount);
+        }
+        else
+        {
+            m_batch.resize(elementCount);
+            size_t offset = 0;
+            for (Client* client : batch)
+            {
+                memcpy(m_batch.data() + offset, reinterpret_cast<Calculation*>(client->region) + client->firstElement,
+                       sizeof(Calculation) * client->elementCount);
+                offset += client->elementCount;
+            }
+
+            compute(m_batch.data(), static_cast<uint32_t>(elementCount));
+
+            offset = 0;
+            for (Client* client : batch)
+            {
+                memcpy(reinterpret_cast<Calculation*>(client->region) + client->firstElement, m_batch.data() + offset,
+                       sizeof(Calculation) * client->elementCount);
+                offset += client->elementCount;
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        status = EIO;
+        m_stats.failedJobs += batch.size();
+    }
+
+    for (Client* client : batch)
+    {
+        client->pending = false;
+        respond(*client, status, status == 0 ? client->elementCount : 0);
+    }
+}
+
+void ComputeServer::respond(Client& client, int32_t status, uint32_t elementCount)
+{
+    ServerProtocol::Response response = { status, elementCount };
+    if (!ServerProtocol::sendMessage(client.socket, &response, sizeof(response)))
+        closeClient(client);
+}
+
+void ComputeServer::closeClient(Client& client)
+{
+    if (client.requestDescriptor >= 0)
+        close(client.requestDescriptor);
+    if (client.region != nullptr)
+        munmap(client.region, client.regionSize);
+    if (client.socket >= 0)
+        close(client.socket);
+    client = Client();
+}
+
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ComputeBackend.h"
+
+// Wire format between ComputeServer and ComputeClient over a Unix domain stream socket. Every
+// message is one fixed-size struct, Calculations never go through the socket.
+namespace ServerProtocol
+{
+    enum MessageType : uint32_t
+    {
+        // Carries a shared memory file descriptor as SCM_RIGHTS, first message of every connection.
+        // On Linux it must be a memfd sealed with F_SEAL_SHRINK.
+        Attach = 1,
+        // Computes elementCount Calculations from firstElement of the shared memory in place
+        Compute = 2,
+        // Stops the server after the current batch, the connection is closed without a response
+        Shutdown = 3,
+    };
+
+    struct Request
+    {
+        uint32_t type;
+        uint32_t elementCount;
+        // Attach: bytes of shared memory, Compute: index of the first Calculation
+        uint64_t value;
+    };
+
+    struct Response
+    {
+        // 0 on success, otherwise an errno value: EINVAL for a request the server does not accept,
+        // EIO if the backend failed the batch
+        int32_t status;
+        uint32_t elementCount;
+    };
+
+    // Blocking and complete, false once the peer is gone. The descriptor is passed with SCM_RIGHTS.
+    bool sendMessage(int socket, const void* data, size_t size, int fileDescriptor = -1);
+    // Any descriptor that arrives with the message is stored in fileDescriptor, -1 if none did
+    bool receiveMessage(int socket, void* data, size_t size, int* fileDescriptor = nullptr);
+    // A socket connected to the server at path, -1 if none is listening
+    int connect(const std::string& path);
+}
+
+// Keeps a set up backend resident and computes jobs from local clients, so a job costs a submit
+// instead of instance, device and pipeline creation. Each client shares one memory region with
+// the server and sends requests over a Unix domain socket. The requests that are ready together
+// are gathered into a single batch, one dispatch serves all of them.
+//
+// The caller sets the backend up before run and shuts it down after. Not available on Windows.
+// Outside Linux shared memory cannot be sealed, a client truncating its region crashes the server.
+class ComputeServer
+{
+public:
+    struct Stats
+    {
+        uint64_t jobs = 0;
+        uint64_t batches = 0;
+        uint64_t elements = 0;
+        uint32_t peakBatchJobs = 0;
+        // Jobs of batches the backend threw on, their clients got EIO
+        uint64_t failedJobs = 0;
+        uint64_t connections = 0;
+    };
+
+    // Replaces a stale socket file, throws if another server is listening on socketPath
+    ComputeServer(ComputeBackend& backend, const std::string& socketPath);
+    ~ComputeServer();
+
+    ComputeServer(const ComputeServer&) = delete;
+    ComputeServer& operator=(const ComputeServer&) = delete;
+
+    // Serves until stop or a Shutdown request, then disconnects every client and removes the socket
+    // file. A server runs once.
+    void run();
+    // Safe to call from other threads and from signal handlers
+    void stop();
+
+    // Requests arriving within this time of the first ready one join its batch. 0 batches only
+    // what is already waiting, which includes everything that arrived during the previous batch.
+    void setBatchWindow(uint32_t microseconds) { m_batchWindowMicroseconds = microseconds; }
+    // Larger batches are split, bounds the gather buffer. run lowers it to the backend's largest
+    // batch, and jobs larger than that are rejected with EINVAL.
+    void setMaxBatchElements(uint32_t elementCount) { m_maxBatchElements = elementCount; }
+
+    const Stats& getStats() const { return m_stats; }
+
+private:
+    struct Client
+    {
+        int socket = -1;
+        // The request being read, the socket does not block so it may arrive over several wakeups
+        ServerProtocol::Request request = {};
+        size_t requestBytes = 0;
+        int requestDescriptor = -1;
+        // Shared memory from the Attach request
+        char* region = nullptr;
+        size_t regionSize = 0;
+
+        bool pending = false;
+        uint64_t firstElement = 0;
+        uint32_t elementCount = 0;
+    };
+
+    void acceptClient();
+    // Reads what has arrived of one request and handles it once complete, false if the client is
+    // gone or broke the protocol
+    bool readRequest(Client& client);
+    void collectRequests(int timeoutMilliseconds);
+    void computePending();
+    void computeBatch(const std::vector<Client*>& batch, uint64_t elementCount);
+    // Closes the connection if the response cannot be sent without blocking, the client is not
+    // reading its responses then
+    void respond(Client& client, int32_t status, uint32_t elementCount);
+    void closeClient(Client& client);
+    void closeSockets();
+
+    ComputeBackend& m_backend;
+    std::string m_socketPath;
+    int m_listenSocket = -1;
+    // The socket file is ours to remove
+    bool m_bound = false;
+    // stop writes to the pipe to wake up poll
+    int m_wakePipe[2] = { -1, -1 };
+    std::atomic<bool> m_stopRequested{ false };
+
+    std::vector<Client> m_clients;
+    // Jobs of several clients are copied together here
+    std::vector<Calculation> m_batch;
+    uint32_t m_batchWindowMicroseconds = 0;
+    uint32_t m_maxBatchElements = 1 << 24;
+    Stats m_stats;
+};
@@ -0,0 +1,100 @@
+#include "CpuBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "Profiler.h"
+
+void CpuBackend::setup()
+{
+    PROFILE_SCOPE("CpuBackend::setup");
+
+    m_threadPool.reset(new ThreadPool(m_threadCount));
+    std::cout << "CPU backend: " << m_threadPool->getThreadCount() << " threads, "
+              << getSimdLevelName(m_simdLevel) << " kernels" << std::endl;
+}
+
+void CpuBackend::shutdown()
+{
+    for (auto& batch : m_batches)
+    {
+        for (std::future<void>& chunk : batch.second)
+            chunk.wait();
+    }
+    m_batches.clear();
+    m_threadPool.reset();
+}
+
+std::string CpuBackend::getName() const
+{
+    return std::string("CPU (") + getSimdLevelName(m_simdLevel) + ", " +
+           std::to_string(m_threadPool ? m_threadPool->getThreadCount() : 0) + " threads)";
+}
+
+BatchHandle CpuBackend::computeBatchAsync(Calculation* calculations, uint32_t elementCount)
+{
+    PROFILE_SCOPE("CpuBackend::computeBatchAsync");
+
+    BatchHandle batch;
+    if (elementCount == 0)
+        return batch;
+
+    // A few chunks per thread so a slow core does not hold up the whole batch, rounded to whole AVX2 vectors
+    uint32_t chunkSize = std::max(m_minChunkSize, elementCount / (m_threadPool->getThreadCount() * 4));
+    chunkSize = (chunkSize + 7) & ~7u;
+
+    std::vector<std::future<void>> chunks;
+    SimdLevel simdLevel = m_simdLevel;
+    for (uint32_t offset = 0; offset < elementCount; offset += chunkSize)
+    {
+        uint32_t count = std::min(chunkSize, elementCount - offset);
+        chunks.push_back(m_threadPool->submit([=]() {
+            addCalculations(calculations + offset, count, simdLevel);
+        }));
+    }
+
+    batch.submit.id = m_nextBatchId++;
+    m_batches[batch.submit.id] = std::move(chunks);
+    return batch;
+}
+
+bool CpuBackend::isBatchComplete(const BatchHandle& batch) const
+{
+    auto it = m_batches.find(batch.submit.id);
+    if (it == m_batches.end())
+        return true;
+
+    for (const std::future<void>& chunk : it->second)
+    {
+        if (chunk.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+    }
+    return true;
+}
+
+void CpuBackend::waitBatch(const BatchHandle& batch)
+{
+    PROFILE_SCOPE("CpuBackend::waitBatch");
+
+    auto it = m_batches.find(batch.submit.id);
+    if (it == m_batches.end())
+        return;
+
+    std::vector<std::future<void>> chunks = std::move(it->second);
+    m_batches.erase(it);
+
+    for (std::future<void>& chunk : chunks)
+        chunk.get();
+}
+
+void CpuBackend::computeSmallBatch(Calculation* calculations, uint32_t elementCount)
+{
+    if (elementCount > maxSmallBatchSize)
+    {
+        waitBatch(computeBatchAsync(calculations, elementCount));
+        return;
+    }
+
+    addCalculations(calculations, elementCount, m_simdLevel);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <future>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "ComputeBackend.h"
+#include "CpuKernels.h"
+#include "ThreadPool.h"
+
+// Runs the kernels as SIMD loops on a pool of worker threads, for nodes without a Vulkan device.
+// The kernel is memory bound, batches are cut into chunks large enough to stream at full bandwidth.
+class CpuBackend : public ComputeBackend
+{
+public:
+    // 0 uses every hardware thread
+    explicit CpuBackend(uint32_t threadCount = 0) : m_threadCount(threadCount) {}
+
+    void setup() override;
+    void shutdown() override;
+    std::string getName() const override;
+
+    using ComputeBackend::computeBatchAsync;
+    BatchHandle computeBatchAsync(Calculation* calculations, uint32_t elementCount) override;
+    bool isBatchComplete(const BatchHandle& batch) const override;
+    void waitBatch(const BatchHandle& batch) override;
+
+    // Runs on the calling thread, waking the workers costs more than the work
+    void computeSmallBatch(Calculation* calculations, uint32_t elementCount) override;
+
+    // Restricts the kernels to an older instruction set, e.g. to compare against AVX2
+    void setSimdLevel(SimdLevel level) { m_simdLevel = level; }
+
+private:
+    uint32_t m_threadCount;
+    SimdLevel m_simdLevel = detectSimdLevel();
+    std::unique_ptr<ThreadPool> m_threadPool;
+
+    // Below this a chunk does not amortize the hand-off to a worker
+    const uint32_t m_minChunkSize = 1 << 16;
+
+    // One future per chunk, keyed by BatchHandle::submit.id
+    std::map<uint64_t, std::vector<std::future<void>>> m_batches;
+    uint64_t m_nextBatchId = 1;
+};
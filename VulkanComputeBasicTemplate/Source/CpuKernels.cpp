@@ -0,0 +1,156 @@
+#include "CpuKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts any intrinsic in any function, GCC and Clang need the target enabled per function
+#if defined(CPU_KERNELS_X86) && !defined(_MSC_VER)
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_TARGET(isa)
+#endif
+
+SimdLevel detectSimdLevel()
+{
+#if defined(CPU_KERNELS_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    // AVX state must also be enabled by the OS (OSXSAVE and XCR0)
+    bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osAvx)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    if (avx2)
+        return SimdLevel::Avx2;
+    if (sse41)
+        return SimdLevel::Sse41;
+#elif defined(CPU_KERNELS_X86)
+    // Also checks that the OS saves the AVX registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SimdLevel::Avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevel::Sse41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char* getSimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::Avx2: return "AVX2";
+        case SimdLevel::Sse41: return "SSE4.1";
+        default: return "scalar";
+    }
+}
+
+static void addCalculationsScalar(Calculation* calculations, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        calculations[i].res = calculations[i].f1 + calculations[i].f2;
+}
+
+#ifdef CPU_KERNELS_X86
+
+// Four calculations are twelve floats in three registers:
+//   v0 = f1 f2 r  f1 | v1 = f2 r  f1 f2 | v2 = r  f1 f2 r
+// Every res lane is the sum of the two floats before it in the stream, so the stream is
+// shifted by one and by two lanes across register boundaries, added and blended into place.
+CPU_TARGET("sse4.1")
+static void addCalculationsSse41(Calculation* calculations, size_t count)
+{
+    float* data = reinterpret_cast<float*>(calculations);
+    size_t vectorCount = count / 4;
+
+    for (size_t i = 0; i < vectorCount; ++i)
+    {
+        float* p = data + i * 12;
+        __m128i v0 = _mm_castps_si128(_mm_loadu_ps(p));
+        __m128i v1 = _mm_castps_si128(_mm_loadu_ps(p + 4));
+        __m128i v2 = _mm_castps_si128(_mm_loadu_ps(p + 8));
+
+        // Lane k of shiftN(v, prev) is the stream element N positions before lane k of v
+        __m128 s0 = _mm_add_ps(_mm_castsi128_ps(_mm_slli_si128(v0, 4)), _mm_castsi128_ps(_mm_slli_si128(v0, 8)));
+        __m128 s1 = _mm_add_ps(_mm_castsi128_ps(_mm_alignr_epi8(v1, v0, 12)), _mm_castsi128_ps(_mm_alignr_epi8(v1, v0, 8)));
+        __m128 s2 = _mm_add_ps(_mm_castsi128_ps(_mm_alignr_epi8(v2, v1, 12)), _mm_castsi128_ps(_mm_alignr_epi8(v2, v1, 8)));
+
+        _mm_storeu_ps(p, _mm_blend_ps(_mm_castsi128_ps(v0), s0, 0x4));
+        _mm_storeu_ps(p + 4, _mm_blend_ps(_mm_castsi128_ps(v1), s1, 0x2));
+        _mm_storeu_ps(p + 8, _mm_blend_ps(_mm_castsi128_ps(v2), s2, 0x9));
+    }
+
+    addCalculationsScalar(calculations + vectorCount * 4, count - vectorCount * 4);
+}
+
+// Eight calculations are 24 floats in three registers. f1 and f2 of the eight sit in disjoint
+// lanes of the three registers, two blends and a permute gather each of them, and the sums are
+// permuted and blended back into the res lanes.
+CPU_TARGET("avx2")
+static void addCalculationsAvx2(Calculation* calculations, size_t count)
+{
+    float* data = reinterpret_cast<float*>(calculations);
+    size_t vectorCount = count / 8;
+
+    const __m256i gatherF1 = _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5);
+    const __m256i gatherF2 = _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6);
+    const __m256i scatter0 = _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 0, 0);
+    const __m256i scatter1 = _mm256_setr_epi32(2, 0, 0, 3, 0, 0, 4, 0);
+    const __m256i scatter2 = _mm256_setr_epi32(0, 5, 0, 0, 6, 0, 0, 7);
+
+    for (size_t i = 0; i < vectorCount; ++i)
+    {
+        float* p = data + i * 24;
+        __m256 v0 = _mm256_loadu_ps(p);
+        __m256 v1 = _mm256_loadu_ps(p + 8);
+        __m256 v2 = _mm256_loadu_ps(p + 16);
+
+        // f1 of element k is stream element 3k: lanes 0,3,6 of v0, 1,4,7 of v1 and 2,5 of v2
+        __m256 f1 = _mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x92), v2, 0x24);
+        // f2 is 3k+1: lanes 1,4,7 of v0, 2,5 of v1 and 0,3,6 of v2
+        __m256 f2 = _mm256_blend_ps(_mm256_blend_ps(v0, v1, 0x24), v2, 0x49);
+
+        __m256 sum = _mm256_add_ps(_mm256_permutevar8x32_ps(f1, gatherF1), _mm256_permutevar8x32_ps(f2, gatherF2));
+
+        // res is 3k+2: lanes 2,5 of v0, 0,3,6 of v1 and 1,4,7 of v2
+        _mm256_storeu_ps(p, _mm256_blend_ps(v0, _mm256_permutevar8x32_ps(sum, scatter0), 0x24));
+        _mm256_storeu_ps(p + 8, _mm256_blend_ps(v1, _mm256_permutevar8x32_ps(sum, scatter1), 0x49));
+        _mm256_storeu_ps(p + 16, _mm256_blend_ps(v2, _mm256_permutevar8x32_ps(sum, scatter2), 0x92));
+    }
+
+    addCalculationsScalar(calculations + vectorCount * 8, count - vectorCount * 8);
+}
+
+#endif
+
+void addCalculations(Calculation* calculations, size_t count, SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef CPU_KERNELS_X86
+        case SimdLevel::Avx2:
+            addCalculationsAvx2(calculations, count);
+            return;
+        case SimdLevel::Sse41:
+            addCalculationsSse41(calculations, count);
+            return;
+#endif
+        default:
+            addCalculationsScalar(calculations, count);
+            return;
+    }
+}
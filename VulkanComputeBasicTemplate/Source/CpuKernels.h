@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Calculation.h"
+
+// Instruction sets the CPU kernels are compiled for, picked at runtime
+enum class SimdLevel
+{
+    Scalar,
+    Sse41,
+    Avx2,
+};
+
+SimdLevel detectSimdLevel();
+const char* getSimdLevelName(SimdLevel level);
+
+// res = f1 + f2 for every calculation, the CPU counterpart of compShader.glsl
+void addCalculations(Calculation* calculations, size_t count, SimdLevel level);
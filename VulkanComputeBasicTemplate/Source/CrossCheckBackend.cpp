@@ -0,0 +1,98 @@
+#include "CrossCheckBackend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+void CrossCheckBackend::setup()
+{
+    m_primary.setup();
+    m_reference.setup();
+}
+
+void CrossCheckBackend::shutdown()
+{
+    std::cout << "Cross-check: " << m_comparedCount << " results matched " << m_reference.getName() << std::endl;
+    m_primary.shutdown();
+    m_reference.shutdown();
+}
+
+std::string CrossCheckBackend::getName() const
+{
+    return m_primary.getName() + " checked against " + m_reference.getName();
+}
+
+uint32_t CrossCheckBackend::getMaxBatchSize() const
+{
+    return std::min(m_primary.getMaxBatchSize(), m_reference.getMaxBatchSize());
+}
+
+BatchHandle CrossCheckBackend::computeBatchAsync(Calculation* calculations, uint32_t elementCount)
+{
+    BatchHandle batch;
+    batch.submit.id = m_nextBatchId++;
+
+    // Copy before the primary backend may start writing results into the inputs
+    PendingBatch& pending = m_pending[batch.submit.id];
+    pending.output = calculations;
+    pending.referenceResults.assign(calculations, calculations + elementCount);
+
+    pending.primary = m_primary.computeBatchAsync(calculations, elementCount);
+    pending.reference = m_reference.computeBatchAsync(pending.referenceResults);
+    return batch;
+}
+
+bool CrossCheckBackend::isBatchComplete(const BatchHandle& batch) const
+{
+    auto it = m_pending.find(batch.submit.id);
+    if (it == m_pending.end())
+        return true;
+
+    return m_primary.isBatchComplete(it->second.primary) && m_reference.isBatchComplete(it->second.reference);
+}
+
+void CrossCheckBackend::waitBatch(const BatchHandle& batch)
+{
+    auto it = m_pending.find(batch.submit.id);
+    if (it == m_pending.end())
+        return;
+
+    PendingBatch pending = std::move(it->second);
+    m_pending.erase(it);
+
+    m_primary.waitBatch(pending.primary);
+    m_reference.waitBatch(pending.reference);
+    compare(pending.output, pending.referenceResults);
+}
+
+void CrossCheckBackend::computeSmallBatch(Calculation* calculations, uint32_t elementCount)
+{
+    std::vector<Calculation> referenceResults(calculations, calculations + elementCount);
+
+    m_primary.computeSmallBatch(calculations, elementCount);
+    m_reference.computeSmallBatch(referenceResults.data(), elementCount);
+    compare(calculations, referenceResults);
+}
+
+void CrossCheckBackend::compare(const Calculation* results, const std::vector<Calculation>& referenceResults)
+{
+    uint32_t mismatches = 0;
+    for (size_t i = 0; i < referenceResults.size(); ++i)
+    {
+        float expected = referenceResults[i].res;
+        if (std::fabs(results[i].res - expected) > m_tolerance * std::fabs(expected))
+        {
+            if (mismatches < 8)
+            {
+                std::cerr << "Cross-check mismatch at " << i << ": " << results[i].res << " from " << m_primary.getName()
+                          << ", " << expected << " from " << m_reference.getName() << std::endl;
+            }
+            ++mismatches;
+        }
+    }
+
+    m_comparedCount += referenceResults.size();
+    if (mismatches > 0)
+        throw std::runtime_error("Cross-check found " + std::to_string(mismatches) + " mismatching results");
+}
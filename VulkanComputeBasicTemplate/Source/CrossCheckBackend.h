@@ -0,0 +1,49 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "ComputeBackend.h"
+
+// Runs every batch on two backends and compares the results. The caller gets the primary
+// backend's results, the reference backend computes into a copy of the inputs.
+class CrossCheckBackend : public ComputeBackend
+{
+public:
+    // Results differing by more than tolerance relative to the reference count as mismatches
+    CrossCheckBackend(ComputeBackend& primary, ComputeBackend& reference, float tolerance = 1e-5f)
+        : m_primary(primary), m_reference(reference), m_tolerance(tolerance) {}
+
+    void setup() override;
+    void shutdown() override;
+    std::string getName() const override;
+
+    using ComputeBackend::computeBatchAsync;
+    BatchHandle computeBatchAsync(Calculation* calculations, uint32_t elementCount) override;
+    bool isBatchComplete(const BatchHandle& batch) const override;
+    // Throws if any result differs
+    void waitBatch(const BatchHandle& batch) override;
+    uint32_t getMaxBatchSize() const override;
+    void computeSmallBatch(Calculation* calculations, uint32_t elementCount) override;
+
+    uint64_t getComparedCount() const { return m_comparedCount; }
+
+private:
+    struct PendingBatch
+    {
+        BatchHandle primary;
+        BatchHandle reference;
+        Calculation* output = nullptr;
+        std::vector<Calculation> referenceResults;
+    };
+
+    void compare(const Calculation* results, const std::vector<Calculation>& referenceResults);
+
+    ComputeBackend& m_primary;
+    ComputeBackend& m_reference;
+    float m_tolerance;
+
+    std::map<uint64_t, PendingBatch> m_pending;
+    uint64_t m_nextBatchId = 1;
+    uint64_t m_comparedCount = 0;
+};
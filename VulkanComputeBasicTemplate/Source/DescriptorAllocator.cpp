@@ -0,0 +1,160 @@
+#include "DescriptorAllocator.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+size_t DescriptorAllocator::KeyHash::operator()(const Key& key) const
+{
+    size_t hash = std::hash<VkDescriptorSetLayout>()(key.layout);
+    for (const BufferBinding& binding : key.bindings)
+    {
+        hash = hash * 31 + std::hash<VkBuffer>()(binding.buffer);
+        hash = hash * 31 + std::hash<VkDeviceSize>()(binding.offset);
+        hash = hash * 31 + std::hash<VkDeviceSize>()(binding.range);
+    }
+    return hash;
+}
+
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPool)
+{
+    m_device = device;
+    m_setsPerPool = setsPerPool;
+}
+
+void DescriptorAllocator::destroy()
+{
+    for (auto& entry : m_layouts)
+    {
+        for (VkDescriptorPool pool : entry.second.pools)
+            vkDestroyDescriptorPool(m_device, pool, nullptr);
+    }
+    m_layouts.clear();
+    m_sets.clear();
+    m_stats.poolCount = 0;
+    m_device = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorAllocator::getSet(VkDescriptorSetLayout layout, const std::vector<BufferBinding>& bindings)
+{
+    Key key = { layout, bindings };
+    auto cached = m_sets.find(key);
+    if (cached != m_sets.end())
+    {
+        ++m_stats.cacheHits;
+        return cached->second;
+    }
+
+    LayoutPools& layoutPools = m_layouts[layout];
+    if (layoutPools.pools.empty())
+        layoutPools.bindingCount = static_cast<uint32_t>(bindings.size());
+    else if (layoutPools.bindingCount != bindings.size())
+        throw std::runtime_error("Binding count does not match the descriptor set layout");
+
+    VkDescriptorSet descriptorSet;
+    if (!layoutPools.freeSets.empty())
+    {
+        descriptorSet = layoutPools.freeSets.back();
+        layoutPools.freeSets.pop_back();
+    }
+    else
+    {
+        descriptorSet = allocate(layout, layoutPools);
+    }
+
+    std::vector<VkDescriptorBufferInfo> bufferInfos(bindings.size());
+    std::vector<VkWriteDescriptorSet> writes(bindings.size());
+    for (size_t i = 0; i < bindings.size(); ++i)
+    {
+        bufferInfos[i].buffer = bindings[i].buffer;
+        bufferInfos[i].offset = bindings[i].offset;
+        bufferInfos[i].range = bindings[i].range;
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = descriptorSet;
+        writes[i].dstBinding = static_cast<uint32_t>(i);
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    ++m_stats.updates;
+
+    m_sets.emplace(std::move(key), descriptorSet);
+    return descriptorSet;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, LayoutPools& layoutPools)
+{
+    if (layoutPools.setsLeft == 0)
+    {
+        // Pools are never freed set by set, so they need no VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
+        VkDescriptorPoolSize descriptorPoolSize = {};
+        descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorPoolSize.descriptorCount = m_setsPerPool * std::max(layoutPools.bindingCount, 1u);
+
+        VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+        descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        descriptorPoolCreateInfo.maxSets = m_setsPerPool;
+        descriptorPoolCreateInfo.poolSizeCount = 1;
+        descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+
+        VkDescriptorPool pool;
+        CHECK_VK_RESULT(vkCreateDescriptorPool(m_device, &descriptorPoolCreateInfo, nullptr, &pool),
+                        "Failed to create descriptor pool");
+        layoutPools.pools.push_back(pool);
+        layoutPools.setsLeft = m_setsPerPool;
+        ++m_stats.poolCount;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = layoutPools.pools.back();
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptorSet;
+    CHECK_VK_RESULT(vkAllocateDescriptorSets(m_device, &allocInfo, &descriptorSet),
+                    "Failed to allocate descriptor sets");
+    --layoutPools.setsLeft;
+    ++m_stats.allocations;
+    return descriptorSet;
+}
+
+void DescriptorAllocator::releaseBuffer(VkBuffer buffer)
+{
+    for (auto it = m_sets.begin(); it != m_sets.end();)
+    {
+        bool references = false;
+        for (const BufferBinding& binding : it->first.bindings)
+            references |= binding.buffer == buffer;
+
+        if (references)
+        {
+            m_layouts[it->first.layout].freeSets.push_back(it->second);
+            it = m_sets.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void DescriptorAllocator::releaseLayout(VkDescriptorSetLayout layout)
+{
+    auto layoutPools = m_layouts.find(layout);
+    if (layoutPools == m_layouts.end())
+        return;
+
+    for (auto it = m_sets.begin(); it != m_sets.end();)
+        it = it->first.layout == layout ? m_sets.erase(it) : std::next(it);
+
+    for (VkDescriptorPool pool : layoutPools->second.pools)
+        vkDestroyDescriptorPool(m_device, pool, nullptr);
+    m_stats.poolCount -= static_cast<uint32_t>(layoutPools->second.pools.size());
+    m_layouts.erase(layoutPools);
+}
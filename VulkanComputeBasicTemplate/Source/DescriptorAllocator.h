@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Allocates storage buffer descriptor sets from pools kept per set layout, and caches written sets
+// by the buffers they point at. Binding a buffer range that was bound before returns the same set
+// without vkAllocateDescriptorSets or vkUpdateDescriptorSets.
+// Not thread-safe, sets are handed out on the thread that records the commands.
+class DescriptorAllocator
+{
+public:
+    struct BufferBinding
+    {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        VkDeviceSize range;
+
+        bool operator==(const BufferBinding& other) const
+        {
+            return buffer == other.buffer && offset == other.offset && range == other.range;
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t allocations = 0;
+        uint64_t updates = 0;
+        uint64_t cacheHits = 0;
+        uint32_t poolCount = 0;
+    };
+
+    // Every pool holds setsPerPool sets of its layout, a full pool is followed by a new one
+    void init(VkDevice device, uint32_t setsPerPool = 64);
+    void destroy();
+
+    // A set of layout with bindings[i] at binding i. All bindings of the layout must be storage
+    // buffers, and every call for one layout must pass the same number of bindings.
+    VkDescriptorSet getSet(VkDescriptorSetLayout layout, const std::vector<BufferBinding>& bindings);
+    VkDescriptorSet getSet(VkDescriptorSetLayout layout, const BufferBinding& binding)
+    {
+        return getSet(layout, std::vector<BufferBinding>(1, binding));
+    }
+
+    // Recycles the cached sets that point at buffer. Call before destroying the buffer, once no
+    // pending command buffer uses those sets, a new buffer may get the same handle.
+    void releaseBuffer(VkBuffer buffer);
+    // Frees the pools of layout and forgets its sets. Call before destroying the layout.
+    void releaseLayout(VkDescriptorSetLayout layout);
+
+    const Stats& getStats() const { return m_stats; }
+    size_t getCachedSetCount() const { return m_sets.size(); }
+
+private:
+    struct LayoutPools
+    {
+        uint32_t bindingCount = 0;
+        std::vector<VkDescriptorPool> pools;
+        // Sets left in pools.back()
+        uint32_t setsLeft = 0;
+        // Released sets, rewritten before they are handed out again
+        std::vector<VkDescriptorSet> freeSets;
+    };
+
+    struct Key
+    {
+        VkDescriptorSetLayout layout;
+        std::vector<BufferBinding> bindings;
+
+        bool operator==(const Key& other) const { return layout == other.layout && bindings == other.bindings; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout, LayoutPools& layoutPools);
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    uint32_t m_setsPerPool = 64;
+    std::unordered_map<VkDescriptorSetLayout, LayoutPools> m_layouts;
+    std::unordered_map<Key, VkDescriptorSet, KeyHash> m_sets;
+    Stats m_stats;
+};
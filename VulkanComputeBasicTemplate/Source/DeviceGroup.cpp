@@ -0,0 +1,204 @@
+#include "DeviceGroup.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <future>
+
+DeviceGroup::~DeviceGroup()
+{
+    // Reached while unwinding when setup or a batch threw, a second exception would terminate
+    try
+    {
+        shutdown();
+    }
+    catch (const std::exception& err)
+    {
+        std::cerr << "Device group shutdown failed: " << err.what() << std::endl;
+    }
+}
+
+void DeviceGroup::Run(uint32_t elementCount)
+{
+    setup();
+
+    std::vector<Calculation> calculations(elementCount);
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        calculations[i].f1 = 3.14f + (float)(i % 1024);
+        calculations[i].f2 = 8.43f * (float)(i % 7);
+        calculations[i].res = 0.f;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    computeBatch(calculations);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    uint32_t mismatches = 0;
+    for (const Calculation& calc : calculations)
+    {
+        if (std::fabs(calc.res - (calc.f1 + calc.f2)) > 1e-5f * std::fabs(calc.f1 + calc.f2))
+            ++mismatches;
+    }
+
+    for (const Device& device : m_devices)
+    {
+        std::cout << "Device: " << device.app->getDeviceProperties().deviceName << ", " << device.elementCount
+                  << " elements, " << device.throughput << " elements/sec" << std::endl;
+    }
+    std::cout << "Elements: " << elementCount << ", mismatches: " << mismatches << std::endl;
+    std::cout << "Batch time over " << m_devices.size() << " devices: " << seconds * 1000.0 << " ms, "
+              << (seconds > 0.0 ? elementCount / seconds : 0.0) << " elements/sec" << std::endl;
+
+    shutdown();
+
+    if (mismatches > 0)
+        throw std::runtime_error("GPU results do not match the CPU reference");
+}
+
+void DeviceGroup::setup()
+{
+    std::vector<uint32_t> deviceIndices = Application::findSuitableDevices();
+    if (deviceIndices.empty())
+        throw std::runtime_error("Could not find a device that can run the compute shader");
+
+    for (uint32_t deviceIndex : deviceIndices)
+    {
+        Device device;
+        device.app.reset(new Application());
+        device.app->setPhysicalDeviceIndex(static_cast<int32_t>(deviceIndex));
+        try
+        {
+            device.app->setup();
+            calibrate(device);
+        }
+        catch (const std::exception& err)
+        {
+            std::cerr << "Device " << deviceIndex << " left out of the group: " << err.what() << std::endl;
+            device.app->shutdown();
+            continue;
+        }
+
+        std::cout << "Device " << deviceIndex << ": " << device.app->getDeviceProperties().deviceName
+                  << ", calibrated at " << device.throughput << " elements/sec" << std::endl;
+        m_devices.push_back(std::move(device));
+    }
+    if (m_devices.empty())
+        throw std::runtime_error("None of the suitable devices could be set up");
+
+    m_threadPool.reset(new ThreadPool(static_cast<uint32_t>(m_devices.size())));
+}
+
+void DeviceGroup::shutdown()
+{
+    m_threadPool.reset();
+    for (Device& device : m_devices)
+        device.app->shutdown();
+    m_devices.clear();
+}
+
+void DeviceGroup::calibrate(Device& device)
+{
+    std::vector<Calculation> calculations(m_calibrationElementCount);
+
+    // The first batch allocates the frame's buffers and records its commands
+    device.app->computeBatch(calculations);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    device.app->computeBatch(calculations);
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    device.throughput = m_calibrationElementCount / std::max(seconds, 1e-9);
+}
+
+void DeviceGroup::split(uint32_t elementCount)
+{
+    for (Device& device : m_devices)
+    {
+        device.offset = 0;
+        device.elementCount = 0;
+    }
+
+    // Only the fastest devices take part in small batches
+    std::vector<Device*> order;
+    for (Device& device : m_devices)
+        order.push_back(&device);
+    std::sort(order.begin(), order.end(), [](const Device* a, const Device* b) { return a->throughput > b->throughput; });
+
+    uint32_t deviceCount = std::min<uint32_t>(static_cast<uint32_t>(order.size()),
+                                              std::max(1u, elementCount / m_minElementsPerDevice));
+    order.resize(deviceCount);
+
+    double totalThroughput = 0.0;
+    for (Device* device : order)
+        totalThroughput += device->throughput;
+
+    // Shares are rounded down to whole workgroups, the fastest device takes the remainder
+    uint32_t offset = 0;
+    for (uint32_t i = deviceCount; i-- > 1;)
+    {
+        Device& device = *order[i];
+        uint32_t granularity = device.app->getWorkgroupSize();
+        uint32_t share = static_cast<uint32_t>(elementCount * (device.throughput / totalThroughput));
+        share -= share % granularity;
+
+        device.offset = offset;
+        device.elementCount = share;
+        offset += share;
+    }
+    order[0]->offset = offset;
+    order[0]->elementCount = elementCount - offset;
+}
+
+void DeviceGroup::computeBatch(std::vector<Calculation>& calculations)
+{
+    PROFILE_SCOPE("DeviceGroup::computeBatch");
+
+    split(static_cast<uint32_t>(calculations.size()));
+
+    // Each device's time covers only its own staging copies and dispatch, and the host blocks
+    // instead of polling while the devices work
+    std::vector<std::future<void>> futures;
+    for (Device& device : m_devices)
+    {
+        if (device.elementCount == 0)
+            continue;
+
+        Calculation* data = calculations.data() + device.offset;
+        futures.push_back(m_threadPool->submit([&device, data]
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            device.app->waitBatch(device.app->computeBatchAsync(data, device.elementCount));
+            device.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        }));
+    }
+
+    // Every range must be written back before calculations may go away, then the first error is rethrown
+    std::exception_ptr error;
+    for (std::future<void>& future : futures)
+    {
+        try
+        {
+            future.get();
+        }
+        catch (...)
+        {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+
+    for (Device& device : m_devices)
+    {
+        if (device.elementCount == 0)
+            continue;
+        double measured = device.elementCount / std::max(device.seconds, 1e-9);
+        device.throughput += m_throughputSmoothing * (measured - device.throughput);
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Application.h"
+#include "ThreadPool.h"
+
+// Opens every suitable physical device, each through its own Application, and splits batches
+// across them in proportion to each device's measured throughput. Every device writes its
+// results straight into its range of the caller's vector.
+class DeviceGroup
+{
+public:
+    // Shuts down whatever devices are still set up
+    ~DeviceGroup();
+
+    void Run(uint32_t elementCount);
+
+    // A suitable device that fails to set up or calibrate is left out, throws if none is left
+    void setup();
+    void shutdown();
+
+    void computeBatch(std::vector<Calculation>& calculations);
+
+    uint32_t getDeviceCount() const { return static_cast<uint32_t>(m_devices.size()); }
+
+private:
+    struct Device
+    {
+        std::unique_ptr<Application> app;
+        // Elements per second, seeded by calibrate and then averaged over the real batches
+        double throughput = 0.0;
+
+        // Range of the current batch
+        uint32_t offset = 0;
+        uint32_t elementCount = 0;
+        // Submit to completion of the current range on the device's own thread
+        double seconds = 0.0;
+    };
+
+    void calibrate(Device& device);
+    void split(uint32_t elementCount);
+
+    std::vector<Device> m_devices;
+    // One thread per device, each stages, submits and waits for its own range
+    std::unique_ptr<ThreadPool> m_threadPool;
+
+    const uint32_t m_calibrationElementCount = 1 << 18;
+    // Smaller batches are not worth splitting, the fixed submit cost dominates
+    const uint32_t m_minElementsPerDevice = 1 << 16;
+    // Weight of the newest measurement in the running throughput average
+    const double m_throughputSmoothing = 0.25;
+};
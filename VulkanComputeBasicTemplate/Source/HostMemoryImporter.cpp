@@ -0,0 +1,170 @@
+#include "HostMemoryImporter.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <algorithm>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+void HostMemoryImporter::init(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties,
+                              bool extensionEnabled)
+{
+    m_device = device;
+    m_memoryProperties = memoryProperties;
+    if (!extensionEnabled)
+        return;
+
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties = {};
+    hostProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &hostProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+    m_alignment = hostProperties.minImportedHostPointerAlignment;
+    m_getMemoryHostPointerProperties =
+        (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT");
+}
+
+void HostMemoryImporter::destroy()
+{
+    for (Region& region : m_regions)
+    {
+        vkDestroyBuffer(m_device, region.buffer, nullptr);
+        vkFreeMemory(m_device, region.memory, nullptr);
+    }
+    m_regions.clear();
+    m_getMemoryHostPointerProperties = nullptr;
+    m_alignment = 0;
+}
+
+bool HostMemoryImporter::import(void* pointer, VkDeviceSize size)
+{
+    if (!isSupported() || size == 0 || reinterpret_cast<uintptr_t>(pointer) % m_alignment != 0 || size % m_alignment != 0)
+        return false;
+
+    VkMemoryHostPointerPropertiesEXT pointerProperties = {};
+    pointerProperties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+    if (m_getMemoryHostPointerProperties(m_device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, pointer,
+                                         &pointerProperties) != VK_SUCCESS)
+        return false;
+
+    Region region;
+    region.pointer = static_cast<char*>(pointer);
+    region.size = size;
+
+    VkExternalMemoryBufferCreateInfo externalBufferCreateInfo = {};
+    externalBufferCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+    externalBufferCreateInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.pNext = &externalBufferCreateInfo;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    CHECK_VK_RESULT(vkCreateBuffer(m_device, &bufferCreateInfo, nullptr, &region.buffer),
+                    "Failed to create imported buffer");
+
+    VkMemoryRequirements memReq;
+    vkGetBufferMemoryRequirements(m_device, region.buffer, &memReq);
+    if (memReq.size > size)
+    {
+        vkDestroyBuffer(m_device, region.buffer, nullptr);
+        return false;
+    }
+
+    // Coherent memory only, host writes before the submit and device writes after the fence then
+    // need no flush or invalidate on a range that was never mapped through Vulkan
+    uint32_t memoryTypeIndex = UINT32_MAX;
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+    {
+        if ((pointerProperties.memoryTypeBits & memReq.memoryTypeBits & (1u << i)) &&
+            (m_memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+        {
+            memoryTypeIndex = i;
+            break;
+        }
+    }
+    if (memoryTypeIndex == UINT32_MAX)
+    {
+        vkDestroyBuffer(m_device, region.buffer, nullptr);
+        return false;
+    }
+
+    VkImportMemoryHostPointerInfoEXT importInfo = {};
+    importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+    importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+    importInfo.pHostPointer = pointer;
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = &importInfo;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    // Imports do not count against the arena, but they do count against maxMemoryAllocationCount
+    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &region.memory) != VK_SUCCESS)
+    {
+        vkDestroyBuffer(m_device, region.buffer, nullptr);
+        return false;
+    }
+
+    CHECK_VK_RESULT(vkBindBufferMemory(m_device, region.buffer, region.memory, 0),
+                    "Failed to bind imported memory");
+
+    m_regions.push_back(region);
+    return true;
+}
+
+void HostMemoryImporter::release(void* pointer)
+{
+    auto it = std::find_if(m_regions.begin(), m_regions.end(), [pointer](const Region& region) {
+        return region.pointer == pointer;
+    });
+    if (it == m_regions.end())
+        return;
+
+    vkDestroyBuffer(m_device, it->buffer, nullptr);
+    vkFreeMemory(m_device, it->memory, nullptr);
+    m_regions.erase(it);
+}
+
+const HostMemoryImporter::Region* HostMemoryImporter::find(const void* pointer, VkDeviceSize size) const
+{
+    const char* begin = static_cast<const char*>(pointer);
+    for (const Region& region : m_regions)
+    {
+        if (begin >= region.pointer && begin + size <= region.pointer + region.size)
+            return &region;
+    }
+    return nullptr;
+}
+
+void* HostMemoryImporter::allocate(VkDeviceSize size) const
+{
+    // Cache line alignment when the extension is missing, the memory is staged anyway
+    size_t alignment = static_cast<size_t>(std::max<VkDeviceSize>(m_alignment, 64));
+    size_t alignedSize = static_cast<size_t>((size + alignment - 1) / alignment * alignment);
+#ifdef _WIN32
+    void* pointer = _aligned_malloc(alignedSize, alignment);
+#else
+    void* pointer = std::aligned_alloc(alignment, alignedSize);
+#endif
+    if (pointer == nullptr)
+        throw std::runtime_error("Failed to allocate host memory");
+    return pointer;
+}
+
+void HostMemoryImporter::free(void* pointer)
+{
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
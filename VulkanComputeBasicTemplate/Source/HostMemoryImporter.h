@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Wraps host allocations in VkDeviceMemory through VK_EXT_external_memory_host, so the device
+// reads and writes them in place instead of going through a staging copy
+class HostMemoryImporter
+{
+public:
+    struct Region
+    {
+        char* pointer = nullptr;
+        VkDeviceSize size = 0;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+    };
+
+    // Without the extension enabled on the device isSupported stays false and nothing is imported
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties,
+              bool extensionEnabled);
+    void destroy();
+
+    bool isSupported() const { return m_getMemoryHostPointerProperties != nullptr; }
+    // minImportedHostPointerAlignment, pointers and sizes passed to import must be multiples of it
+    VkDeviceSize getAlignment() const { return m_alignment; }
+
+    // False if the range is misaligned or the driver cannot import it, callers then stage the data.
+    // The memory must stay allocated until release.
+    bool import(void* pointer, VkDeviceSize size);
+    void release(void* pointer);
+    // The region containing [pointer, pointer + size), nullptr if there is none
+    const Region* find(const void* pointer, VkDeviceSize size) const;
+
+    // Host memory that satisfies the alignment rules, size is rounded up to the alignment
+    void* allocate(VkDeviceSize size) const;
+    static void free(void* pointer);
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+    VkDeviceSize m_alignment = 0;
+    PFN_vkGetMemoryHostPointerPropertiesEXT m_getMemoryHostPointerProperties = nullptr;
+    std::vector<Region> m_regions;
+};
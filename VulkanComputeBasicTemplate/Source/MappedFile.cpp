@@ -0,0 +1,96 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t getPageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+void MappedFile::open(const std::string& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open file: " + path);
+    m_file = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        close();
+        throw std::runtime_error("Cannot map empty file: " + path);
+    }
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+
+    m_mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    m_data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+#else
+    m_file = ::open(path.c_str(), O_RDWR);
+    if (m_file < 0)
+        throw std::runtime_error("Failed to open file: " + path);
+
+    struct stat fileStat;
+    if (fstat(m_file, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close();
+        throw std::runtime_error("Cannot map empty file: " + path);
+    }
+    m_size = static_cast<size_t>(fileStat.st_size);
+
+    void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+    m_data = data == MAP_FAILED ? nullptr : data;
+#endif
+
+    if (m_data == nullptr)
+    {
+        close();
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+
+    size_t pageSize = getPageSize();
+    m_mappedSize = (m_size + pageSize - 1) / pageSize * pageSize;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if (m_data)
+        munmap(m_data, m_size);
+    if (m_file >= 0)
+        ::close(m_file);
+    m_file = -1;
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mappedSize = 0;
+}
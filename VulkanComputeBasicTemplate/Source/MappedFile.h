@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A file mapped read-write into the address space, writes go back to the file. The mapping
+// starts page aligned, so it can be imported with HostMemoryImporter.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void open(const std::string& path);
+    void close();
+
+    void* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    // size rounded up to whole pages, the bytes past the end of the file read as zero
+    size_t getMappedSize() const { return m_mappedSize; }
+
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_mappedSize = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+};
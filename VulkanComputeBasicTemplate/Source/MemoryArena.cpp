@@ -0,0 +1,291 @@
+#include "MemoryArena.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+void MemoryArena::init(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties,
+                       const VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize blockSize)
+{
+    m_device = device;
+    m_blockSize = blockSize;
+    m_bufferImageGranularity = std::max<VkDeviceSize>(deviceProperties.limits.bufferImageGranularity, 1);
+    m_nonCoherentAtomSize = std::max<VkDeviceSize>(deviceProperties.limits.nonCoherentAtomSize, 1);
+    m_maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+    m_memoryProperties = memoryProperties;
+}
+
+void MemoryArena::destroy()
+{
+    for (std::unique_ptr<Block>& block : m_blocks)
+    {
+        if (block)
+        {
+            if (block->mapped)
+                vkUnmapMemory(m_device, block->memory);
+            vkFreeMemory(m_device, block->memory, nullptr);
+        }
+    }
+    m_blocks.clear();
+    m_liveBlockCount = 0;
+}
+
+bool MemoryArena::conflictsOnPage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const
+{
+    // Linear and non-linear resources closer than bufferImageGranularity alias on some hardware
+    return (endOfFirst - 1) / m_bufferImageGranularity == startOfSecond / m_bufferImageGranularity;
+}
+
+bool MemoryArena::allocateFromBlock(Block& block, const VkMemoryRequirements& memReq, bool linear, VkDeviceSize& offset)
+{
+    for (auto freeIt = block.freeRanges.begin(); freeIt != block.freeRanges.end(); ++freeIt)
+    {
+        VkDeviceSize rangeStart = freeIt->first;
+        VkDeviceSize rangeEnd = freeIt->first + freeIt->second;
+        if (freeIt->second < memReq.size)
+            continue;
+
+        VkDeviceSize candidate = alignUp(rangeStart, memReq.alignment);
+
+        // A free range is always bordered by used ranges (or the block edges), check both neighbours
+        auto nextIt = block.usedRanges.lower_bound(rangeEnd);
+        if (nextIt != block.usedRanges.begin())
+        {
+            auto prevIt = std::prev(nextIt);
+            if (prevIt->second.linear != linear && conflictsOnPage(prevIt->first + prevIt->second.size, candidate))
+                candidate = alignUp(candidate, m_bufferImageGranularity);
+        }
+
+        if (candidate + memReq.size > rangeEnd)
+            continue;
+
+        if (nextIt != block.usedRanges.end() && nextIt->second.linear != linear &&
+            conflictsOnPage(candidate + memReq.size, nextIt->first))
+            continue;
+
+        block.freeRanges.erase(freeIt);
+        if (candidate > rangeStart)
+            block.freeRanges[rangeStart] = candidate - rangeStart;
+        if (candidate + memReq.size < rangeEnd)
+            block.freeRanges[candidate + memReq.size] = rangeEnd - (candidate + memReq.size);
+
+        block.usedRanges[candidate] = { memReq.size, linear };
+        offset = candidate;
+        return true;
+    }
+
+    return false;
+}
+
+uint32_t MemoryArena::createBlock(VkDeviceSize size, uint32_t memoryTypeIndex)
+{
+    if (m_liveBlockCount >= m_maxAllocationCount)
+        throw std::runtime_error("Memory arena exceeded maxMemoryAllocationCount");
+
+    std::unique_ptr<Block> block(new Block());
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->freeRanges[0] = size;
+
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = size;
+    allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+    CHECK_VK_RESULT(vkAllocateMemory(m_device, &allocateInfo, nullptr, &block->memory),
+                    "Failed to allocate memory arena block");
+
+    ++m_liveBlockCount;
+
+    // Host-visible blocks are mapped once here and stay mapped until they are released
+    VkMemoryPropertyFlags propertyFlags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    if (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        void* mapped = nullptr;
+        CHECK_VK_RESULT(vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped),
+                        "Failed to map memory arena block");
+        block->mapped = static_cast<char*>(mapped);
+        block->coherent = (propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    }
+
+    for (uint32_t i = 0; i < m_blocks.size(); ++i)
+    {
+        if (!m_blocks[i])
+        {
+            m_blocks[i] = std::move(block);
+            return i;
+        }
+    }
+
+    m_blocks.push_back(std::move(block));
+    return static_cast<uint32_t>(m_blocks.size() - 1);
+}
+
+Allocation MemoryArena::allocate(const VkMemoryRequirements& memReq, uint32_t memoryTypeIndex, bool linear)
+{
+    Allocation allocation;
+    allocation.size = memReq.size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+
+    for (uint32_t i = 0; i < m_blocks.size(); ++i)
+    {
+        Block* block = m_blocks[i].get();
+        if (!block || block->memoryTypeIndex != memoryTypeIndex)
+            continue;
+
+        if (allocateFromBlock(*block, memReq, linear, allocation.offset))
+        {
+            allocation.blockIndex = i;
+            fillAllocation(allocation, *block);
+            return allocation;
+        }
+    }
+
+    // Nothing fits, grab a new block. Requests larger than the block size get a dedicated one,
+    // and blocks never take more than an eighth of a small heap.
+    VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+    VkDeviceSize blockSize = std::min(m_blockSize, std::max<VkDeviceSize>(heapSize / 8, 1));
+    blockSize = std::max(blockSize, memReq.size);
+
+    allocation.blockIndex = createBlock(blockSize, memoryTypeIndex);
+    Block& block = *m_blocks[allocation.blockIndex];
+    if (!allocateFromBlock(block, memReq, linear, allocation.offset))
+        throw std::runtime_error("Memory arena failed to place allocation in a new block");
+
+    fillAllocation(allocation, block);
+    return allocation;
+}
+
+void MemoryArena::fillAllocation(Allocation& allocation, const Block& block) const
+{
+    allocation.memory = block.memory;
+    allocation.mapped = block.mapped ? block.mapped + allocation.offset : nullptr;
+    allocation.coherent = block.coherent;
+}
+
+VkMappedMemoryRange MemoryArena::makeAtomRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+{
+    const Block& block = *m_blocks[allocation.blockIndex];
+
+    VkDeviceSize start = allocation.offset + offset;
+    VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.offset + allocation.size : start + size;
+
+    // Ranges must start and end on nonCoherentAtomSize, or at the end of the memory object
+    start = start / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+    end = std::min(alignUp(end, m_nonCoherentAtomSize), block.size);
+
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = block.memory;
+    range.offset = start;
+    range.size = end - start;
+    return range;
+}
+
+void MemoryArena::flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (allocation.mapped == nullptr || allocation.coherent)
+        return;
+
+    VkMappedMemoryRange range = makeAtomRange(allocation, offset, size);
+    CHECK_VK_RESULT(vkFlushMappedMemoryRanges(m_device, 1, &range),
+                    "Failed to flush mapped memory");
+}
+
+void MemoryArena::invalidate(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (allocation.mapped == nullptr || allocation.coherent)
+        return;
+
+    VkMappedMemoryRange range = makeAtomRange(allocation, offset, size);
+    CHECK_VK_RESULT(vkInvalidateMappedMemoryRanges(m_device, 1, &range),
+                    "Failed to invalidate mapped memory");
+}
+
+void MemoryArena::free(const Allocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+        return;
+
+    Block& block = *m_blocks[allocation.blockIndex];
+    auto usedIt = block.usedRanges.find(allocation.offset);
+    if (usedIt == block.usedRanges.end())
+        throw std::runtime_error("Freeing an allocation that is not owned by the memory arena");
+
+    VkDeviceSize start = allocation.offset;
+    VkDeviceSize end = allocation.offset + usedIt->second.size;
+    block.usedRanges.erase(usedIt);
+
+    // Coalesce with the neighbouring free ranges. Alignment padding in front of an allocation
+    // stays in the free list, so the neighbours are always exactly adjacent.
+    auto nextIt = block.freeRanges.lower_bound(start);
+    if (nextIt != block.freeRanges.end() && nextIt->first == end)
+    {
+        end += nextIt->second;
+        nextIt = block.freeRanges.erase(nextIt);
+    }
+    if (nextIt != block.freeRanges.begin())
+    {
+        auto prevIt = std::prev(nextIt);
+        if (prevIt->first + prevIt->second == start)
+        {
+            start = prevIt->first;
+            block.freeRanges.erase(prevIt);
+        }
+    }
+    block.freeRanges[start] = end - start;
+
+    // Keep one empty block per memory type around so alternating alloc/free does not hit the driver
+    if (block.usedRanges.empty())
+    {
+        bool otherEmptyBlock = false;
+        for (uint32_t i = 0; i < m_blocks.size(); ++i)
+        {
+            if (i != allocation.blockIndex && m_blocks[i] && m_blocks[i]->memoryTypeIndex == block.memoryTypeIndex &&
+                m_blocks[i]->usedRanges.empty())
+                otherEmptyBlock = true;
+        }
+
+        if (otherEmptyBlock)
+        {
+            if (block.mapped)
+                vkUnmapMemory(m_device, block.memory);
+            vkFreeMemory(m_device, block.memory, nullptr);
+            m_blocks[allocation.blockIndex].reset();
+            --m_liveBlockCount;
+        }
+    }
+}
+
+MemoryArena::Stats MemoryArena::getStats() const
+{
+    Stats stats;
+    for (const std::unique_ptr<Block>& block : m_blocks)
+    {
+        if (!block)
+            continue;
+
+        ++stats.blockCount;
+        stats.reservedBytes += block->size;
+        stats.allocationCount += static_cast<uint32_t>(block->usedRanges.size());
+        for (const auto& used : block->usedRanges)
+            stats.usedBytes += used.second.size;
+        for (const auto& range : block->freeRanges)
+        {
+            stats.freeBytes += range.second;
+            stats.largestFreeRange = std::max(stats.largestFreeRange, range.second);
+            ++stats.freeRangeCount;
+        }
+    }
+
+    if (stats.freeBytes > 0)
+        stats.fragmentation = 1.f - (float)stats.largestFreeRange / (float)stats.freeBytes;
+
+    return stats;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <memory>
+#include <vector>
+
+// A range of a VkDeviceMemory block handed out by MemoryArena
+struct Allocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memoryTypeIndex = 0;
+    uint32_t blockIndex = 0;
+    // Host address of offset for host-visible memory types, which stay mapped for the block's lifetime
+    void* mapped = nullptr;
+    bool coherent = false;
+};
+
+// Sub-allocates resources from large VkDeviceMemory blocks, one set of blocks per memory type,
+// so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount.
+// Each block keeps an offset-ordered free list that is coalesced on free.
+class MemoryArena
+{
+public:
+    struct Stats
+    {
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+        VkDeviceSize reservedBytes = 0;
+        VkDeviceSize usedBytes = 0;
+        VkDeviceSize freeBytes = 0;
+        VkDeviceSize largestFreeRange = 0;
+        uint32_t freeRangeCount = 0;
+        // 0 when all free memory is one contiguous range, approaching 1 as it is split into small holes
+        float fragmentation = 0.f;
+    };
+
+    void init(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties,
+              const VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize blockSize = 64 * 1024 * 1024);
+    void destroy();
+
+    // linear is false for optimally tiled images, which must not share a bufferImageGranularity page with buffers
+    Allocation allocate(const VkMemoryRequirements& memReq, uint32_t memoryTypeIndex, bool linear = true);
+    void free(const Allocation& allocation);
+
+    // Make host writes visible to the device and device writes visible to the host. No-ops on
+    // HOST_COHERENT memory, otherwise the range is widened to nonCoherentAtomSize.
+    void flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+    void invalidate(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+    Stats getStats() const;
+
+private:
+    struct UsedRange
+    {
+        VkDeviceSize size;
+        bool linear;
+    };
+
+    struct Block
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeIndex = 0;
+        char* mapped = nullptr;
+        bool coherent = false;
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+        std::map<VkDeviceSize, UsedRange> usedRanges;
+    };
+
+    bool allocateFromBlock(Block& block, const VkMemoryRequirements& memReq, bool linear, VkDeviceSize& offset);
+    bool conflictsOnPage(VkDeviceSize endOfFirst, VkDeviceSize startOfSecond) const;
+    uint32_t createBlock(VkDeviceSize size, uint32_t memoryTypeIndex);
+    void fillAllocation(Allocation& allocation, const Block& block) const;
+    VkMappedMemoryRange makeAtomRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkDeviceSize m_blockSize = 0;
+    VkDeviceSize m_bufferImageGranularity = 1;
+    VkDeviceSize m_nonCoherentAtomSize = 1;
+    uint32_t m_maxAllocationCount = 0;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+
+    // Released blocks leave an empty slot so the indices held by live allocations stay valid
+    std::vector<std::unique_ptr<Block>> m_blocks;
+    uint32_t m_liveBlockCount = 0;
+};
@@ -0,0 +1,132 @@
+#include "PipelineBuilder.h"
+
+#include <stdexcept>
+#include <future>
+
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+// Keeps the specialization info of one pipeline alive until it is created
+struct SpecializationStorage
+{
+    std::vector<VkSpecializationMapEntry> entries;
+    VkSpecializationInfo info = {};
+};
+
+static void fillSpecialization(const std::vector<uint32_t>& constants, SpecializationStorage& storage)
+{
+    storage.entries.resize(constants.size());
+    for (uint32_t i = 0; i < constants.size(); ++i)
+    {
+        storage.entries[i].constantID = i;
+        storage.entries[i].offset = i * sizeof(uint32_t);
+        storage.entries[i].size = sizeof(uint32_t);
+    }
+
+    storage.info.mapEntryCount = static_cast<uint32_t>(storage.entries.size());
+    storage.info.pMapEntries = storage.entries.data();
+    storage.info.dataSize = sizeof(uint32_t) * constants.size();
+    storage.info.pData = constants.data();
+}
+
+static VkComputePipelineCreateInfo makePipelineCreateInfo(const PipelineBuilder::ComputePipelineDesc& desc,
+                                                          const VkPipelineShaderStageCreateInfo& stage,
+                                                          SpecializationStorage& specialization)
+{
+    VkComputePipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage = stage;
+    pipelineCreateInfo.layout = desc.layout;
+
+    if (!desc.specializationConstants.empty())
+    {
+        fillSpecialization(desc.specializationConstants, specialization);
+        pipelineCreateInfo.stage.pSpecializationInfo = &specialization.info;
+    }
+    return pipelineCreateInfo;
+}
+
+// Waits for every future, then rethrows the first error
+static void waitAll(std::vector<std::future<void>>& futures)
+{
+    std::exception_ptr error;
+    for (std::future<void>& future : futures)
+    {
+        try
+        {
+            future.get();
+        }
+        catch (...)
+        {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+std::vector<VkPipeline> PipelineBuilder::createComputePipelines(ShaderModuleCache& moduleCache, VkPipelineCache pipelineCache,
+                                                                const std::vector<ComputePipelineDesc>& descs, ThreadPool& pool, Mode mode,
+                                                                std::vector<ShaderModuleRef>* shaderModules)
+{
+    PROFILE_SCOPE("createComputePipelines");
+
+    VkDevice device = moduleCache.getDevice();
+    std::vector<VkPipeline> pipelines(descs.size(), VK_NULL_HANDLE);
+    // Only needed until vkCreateComputePipelines returns, unless the caller keeps them
+    std::vector<ShaderModuleRef> modules(descs.size());
+    std::vector<SpecializationStorage> specializations(descs.size());
+
+    try
+    {
+        if (mode == Mode::PerThread)
+        {
+            // VkPipelineCache is internally synchronized, the workers share it without a lock
+            std::vector<std::future<void>> futures;
+            for (size_t i = 0; i < descs.size(); ++i)
+            {
+                futures.push_back(pool.submit([&, i]() {
+                    const ComputePipelineDesc& desc = descs[i];
+                    modules[i] = moduleCache.get(ShaderLoader::compileToSpirv(desc.shader));
+                    VkComputePipelineCreateInfo pipelineCreateInfo =
+                        makePipelineCreateInfo(desc, modules[i]->getStageCreateInfo(desc.shader.stage), specializations[i]);
+                    CHECK_VK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines[i]),
+                                    "Failed to create compute pipeline");
+                }));
+            }
+            waitAll(futures);
+        }
+        else
+        {
+            std::vector<ShaderLoader::ShaderRequest> requests;
+            for (const ComputePipelineDesc& desc : descs)
+                requests.push_back(desc.shader);
+            modules = ShaderLoader::compileAndLoadShaders(moduleCache, requests, pool);
+
+            std::vector<VkComputePipelineCreateInfo> pipelineCreateInfos;
+            for (size_t i = 0; i < descs.size(); ++i)
+            {
+                VkPipelineShaderStageCreateInfo stage = modules[i]->getStageCreateInfo(descs[i].shader.stage);
+                pipelineCreateInfos.push_back(makePipelineCreateInfo(descs[i], stage, specializations[i]));
+            }
+
+            CHECK_VK_RESULT(vkCreateComputePipelines(device, pipelineCache, static_cast<uint32_t>(pipelineCreateInfos.size()),
+                                                     pipelineCreateInfos.data(), nullptr, pipelines.data()),
+                            "Failed to create compute pipelines");
+        }
+    }
+    catch (...)
+    {
+        // A failed batch call leaves VK_NULL_HANDLE in the failed slots, destroying those is a no-op
+        for (VkPipeline pipeline : pipelines)
+            vkDestroyPipeline(device, pipeline, nullptr);
+        throw;
+    }
+
+    if (shaderModules)
+        *shaderModules = std::move(modules);
+    return pipelines;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "ShaderLoader.h"
+
+class ThreadPool;
+
+// Builds many compute pipelines at once, compiling the shaders on a thread pool
+class PipelineBuilder
+{
+public:
+    struct ComputePipelineDesc
+    {
+        ShaderLoader::ShaderRequest shader;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        // Element i is the value of constant_id i
+        std::vector<uint32_t> specializationConstants;
+    };
+
+    enum class Mode
+    {
+        // Every worker compiles its shader and creates its pipeline against the shared cache,
+        // so one pipeline's creation overlaps the next one's compile
+        PerThread,
+        // All shaders are compiled in parallel, then one vkCreateComputePipelines call creates
+        // every pipeline, leaving the parallelism to the driver
+        Batched,
+    };
+
+    // Results are in desc order. On failure every pipeline already created is destroyed.
+    // shaderModules receives the module of each pipeline, holding on to them keeps rebuilds from
+    // recreating the modules.
+    static std::vector<VkPipeline> createComputePipelines(ShaderModuleCache& moduleCache, VkPipelineCache pipelineCache,
+                                                          const std::vector<ComputePipelineDesc>& descs, ThreadPool& pool,
+                                                          Mode mode = Mode::PerThread,
+                                                          std::vector<ShaderModuleRef>* shaderModules = nullptr);
+};
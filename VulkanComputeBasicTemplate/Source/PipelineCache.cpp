@@ -0,0 +1,102 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "Profiler.h"
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+void PipelineCache::load(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties, const std::string& path)
+{
+    PROFILE_SCOPE("PipelineCache::load");
+
+    m_device = device;
+    m_path = path;
+    m_warm = false;
+
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (file.is_open())
+    {
+        data.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        file.close();
+
+        if (!isCompatible(data, deviceProperties))
+        {
+            std::cout << "Discarding stale pipeline cache " << path << std::endl;
+            data.clear();
+            std::remove(path.c_str());
+        }
+    }
+
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.initialDataSize = data.size();
+    pipelineCacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    CHECK_VK_RESULT(vkCreatePipelineCache(m_device, &pipelineCacheCreateInfo, nullptr, &m_pipelineCache),
+                    "Failed to create pipeline cache");
+
+    m_warm = !data.empty();
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& deviceProperties) const
+{
+    if (data.size() < sizeof(VkPipelineCacheHeaderVersionOne))
+        return false;
+
+    VkPipelineCacheHeaderVersionOne header;
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) &&
+           header.headerSize <= data.size() &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == deviceProperties.vendorID &&
+           header.deviceID == deviceProperties.deviceID &&
+           memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save()
+{
+    PROFILE_SCOPE("PipelineCache::save");
+
+    if (m_pipelineCache == VK_NULL_HANDLE)
+        return;
+
+    size_t dataSize = 0;
+    CHECK_VK_RESULT(vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, nullptr),
+                    "Failed to query pipeline cache size");
+
+    std::vector<char> data(dataSize);
+    CHECK_VK_RESULT(vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, data.data()),
+                    "Failed to read pipeline cache data");
+
+    // Write next to the target and rename so an interrupted run never leaves a truncated cache
+    std::string tmpPath = m_path + ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to write pipeline cache " << m_path << std::endl;
+        return;
+    }
+    file.write(data.data(), dataSize);
+    file.close();
+
+    std::remove(m_path.c_str());
+    if (std::rename(tmpPath.c_str(), m_path.c_str()) != 0)
+        std::cerr << "Failed to write pipeline cache " << m_path << std::endl;
+}
+
+void PipelineCache::destroy()
+{
+    if (m_pipelineCache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+    m_pipelineCache = VK_NULL_HANDLE;
+}
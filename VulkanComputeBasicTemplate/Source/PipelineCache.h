@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+// VkPipelineCache persisted to disk between runs so the driver can skip compiling SPIR-V to
+// device code. A file written by a different device or driver is discarded on load.
+class PipelineCache
+{
+public:
+    void load(VkDevice device, const VkPhysicalDeviceProperties& deviceProperties, const std::string& path);
+    void save();
+    void destroy();
+
+    VkPipelineCache get() const { return m_pipelineCache; }
+    bool isWarm() const { return m_warm; }
+
+private:
+    bool isCompatible(const std::vector<char>& data, const VkPhysicalDeviceProperties& deviceProperties) const;
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    std::string m_path;
+    bool m_warm = false;
+};
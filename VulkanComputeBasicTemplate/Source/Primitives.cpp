@@ -0,0 +1,208 @@
+#include "Primitives.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+#include "Application.h"
+
+typedef ComputeGraph::BufferKind Kind;
+typedef ComputeGraph::BufferId BufferId;
+
+static VkDeviceSize wordsSize(uint32_t count)
+{
+    return sizeof(uint32_t) * static_cast<VkDeviceSize>(count);
+}
+
+Primitives::Primitives(Application& app)
+    : m_app(app)
+{
+    // 16 or more invocations per subgroup keep the subgroups of a 256 invocation workgroup within
+    // one subgroup, which the kernels scan the subgroup totals with
+    const VkPhysicalDeviceSubgroupProperties& subgroup = app.getSubgroupProperties();
+    VkSubgroupFeatureFlags required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    m_subgroupSupported = (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+                          (subgroup.supportedOperations & required) == required &&
+                          subgroup.subgroupSize >= 16;
+    m_useSubgroups = m_subgroupSupported;
+}
+
+void Primitives::setUseSubgroups(bool enabled)
+{
+    m_useSubgroups = enabled && m_subgroupSupported;
+}
+
+Primitives::Plan& Primitives::getPlan(Operation operation, uint32_t count, const std::vector<const void*>& pointers, bool& build)
+{
+    Plan& plan = m_plans[operation];
+    build = !plan.graph || plan.count != count || plan.pointers != pointers || plan.subgroups != m_useSubgroups;
+    if (!build)
+        return plan;
+
+    plan.graph.reset(new ComputeGraph(m_app));
+    plan.pointers = pointers;
+    plan.count = count;
+    plan.subgroups = m_useSubgroups;
+    plan.hostWords.clear();
+    plan.scalarResult = nullptr;
+    if (m_useSubgroups)
+        plan.graph->setShaderOptions({ { "SUBGROUPS", "1" } }, VK_API_VERSION_1_1);
+    return plan;
+}
+
+BufferId Primitives::addHostWords(Plan& plan, const std::string& name, Kind kind, std::array<uint32_t, 4> words, uint32_t** hostData)
+{
+    plan.hostWords.push_back(words);
+    if (hostData)
+        *hostData = plan.hostWords.back().data();
+    return plan.graph->addBuffer(name, sizeof(words), kind, plan.hostWords.back().data());
+}
+
+void Primitives::addStage(Plan& plan, const std::string& shaderName, const std::vector<ComputeGraph::Binding>& bindings, uint32_t count)
+{
+    uint32_t blockCount = std::max(1u, (count + blockSize - 1) / blockSize);
+    uint32_t groupCountX = std::min(blockCount, m_app.getDeviceProperties().limits.maxComputeWorkGroupCount[0]);
+    uint32_t groupCountY = (blockCount + groupCountX - 1) / groupCountX;
+    plan.graph->addStage("../Shaders/" + shaderName + ".glsl", bindings, groupCountX, groupCountY);
+}
+
+void Primitives::addScan(Plan& plan, BufferId in, BufferId out, uint32_t count, bool inclusive, bool countNonZero)
+{
+    ComputeGraph& graph = *plan.graph;
+    uint32_t blockCount = (count + blockSize - 1) / blockSize;
+    BufferId blockSums = graph.addBuffer("blockSums", wordsSize(blockCount), Kind::Transient);
+    BufferId params = addHostWords(plan, "scanParams", Kind::Input, { inclusive ? 1u : 0u, countNonZero ? 1u : 0u, 0, 0 });
+    addStage(plan, "primScan", { { in, false }, { out, true }, { blockSums, true }, { params, false } }, count);
+
+    if (blockCount > 1)
+    {
+        BufferId blockOffsets = graph.addBuffer("blockOffsets", wordsSize(blockCount), Kind::Transient);
+        addScan(plan, blockSums, blockOffsets, blockCount, false, false);
+        addStage(plan, "primAddOffsets", { { blockOffsets, false }, { out, true } }, count);
+    }
+}
+
+uint32_t Primitives::reduce(const uint32_t* values, uint32_t count)
+{
+    if (count == 0)
+        return 0;
+
+    bool build;
+    Plan& plan = getPlan(Reduce, count, { values }, build);
+    if (build)
+    {
+        // Every level turns each block into one partial sum until a single block is left
+        ComputeGraph& graph = *plan.graph;
+        BufferId current = graph.addBuffer("values", wordsSize(count), Kind::Input, const_cast<uint32_t*>(values));
+        for (uint32_t remaining = count;;)
+        {
+            uint32_t blockCount = (remaining + blockSize - 1) / blockSize;
+            BufferId partials = blockCount == 1
+                                ? addHostWords(plan, "sum", Kind::Output, {}, &plan.scalarResult)
+                                : graph.addBuffer("partials", wordsSize(blockCount), Kind::Transient);
+            addStage(plan, "primReduce", { { current, false }, { partials, true } }, remaining);
+            if (blockCount == 1)
+                break;
+            current = partials;
+            remaining = blockCount;
+        }
+    }
+
+    // The sum is the first word of a four word buffer, the rest is never written
+    plan.graph->run();
+    return *plan.scalarResult;
+}
+
+void Primitives::scan(Operation operation, const uint32_t* values, uint32_t* result, uint32_t count)
+{
+    if (count == 0)
+        return;
+
+    bool build;
+    Plan& plan = getPlan(operation, count, { values, result }, build);
+    if (build)
+    {
+        ComputeGraph& graph = *plan.graph;
+        BufferId in = graph.addBuffer("values", wordsSize(count), Kind::Input, const_cast<uint32_t*>(values));
+        BufferId out = graph.addBuffer("result", wordsSize(count), Kind::Output, result);
+        addScan(plan, in, out, count, operation == InclusiveScan, false);
+    }
+    plan.graph->run();
+}
+
+void Primitives::exclusiveScan(const uint32_t* values, uint32_t* result, uint32_t count)
+{
+    scan(ExclusiveScan, values, result, count);
+}
+
+void Primitives::inclusiveScan(const uint32_t* values, uint32_t* result, uint32_t count)
+{
+    scan(InclusiveScan, values, result, count);
+}
+
+uint32_t Primitives::compact(const uint32_t* values, const uint32_t* flags, uint32_t* result, uint32_t count)
+{
+    if (count == 0)
+        return 0;
+
+    bool build;
+    Plan& plan = getPlan(Compact, count, { values, flags, result }, build);
+    if (build)
+    {
+        // The exclusive scan of the flags is each kept value's position
+        ComputeGraph& graph = *plan.graph;
+        BufferId in = graph.addBuffer("values", wordsSize(count), Kind::Input, const_cast<uint32_t*>(values));
+        BufferId flagBuffer = graph.addBuffer("flags", wordsSize(count), Kind::Input, const_cast<uint32_t*>(flags));
+        BufferId positions = graph.addBuffer("positions", wordsSize(count), Kind::Transient);
+        BufferId out = graph.addBuffer("result", wordsSize(count), Kind::Output, result);
+        BufferId kept = addHostWords(plan, "keptCount", Kind::Output, {}, &plan.scalarResult);
+
+        addScan(plan, flagBuffer, positions, count, false, true);
+        addStage(plan, "primCompact", { { in, false }, { flagBuffer, false }, { positions, false }, { out, true }, { kept, true } },
+                 count);
+    }
+
+    plan.graph->run();
+    return *plan.scalarResult;
+}
+
+void Primitives::sortPairs(uint32_t* keys, uint32_t* values, uint32_t count)
+{
+    if (count <= 1)
+        return;
+
+    bool build;
+    Plan& plan = getPlan(SortPairs, count, { keys, values }, build);
+    if (build)
+    {
+        ComputeGraph& graph = *plan.graph;
+        uint32_t blockCount = (count + blockSize - 1) / blockSize;
+        uint32_t histogramSize = 16 * blockCount;
+
+        // The passes ping-pong through transients, the graph lets them share memory
+        BufferId sourceKeys = graph.addBuffer("keys", wordsSize(count), Kind::Input, keys);
+        BufferId sourceValues = graph.addBuffer("values", wordsSize(count), Kind::Input, values);
+        for (uint32_t shift = 0; shift < 32; shift += 4)
+        {
+            bool last = shift + 4 == 32;
+            BufferId params = addHostWords(plan, "radixParams", Kind::Input, { shift, 0, 0, 0 });
+            BufferId localKeys = graph.addBuffer("localKeys", wordsSize(count), Kind::Transient);
+            BufferId localValues = graph.addBuffer("localValues", wordsSize(count), Kind::Transient);
+            BufferId histogram = graph.addBuffer("histogram", wordsSize(histogramSize), Kind::Transient);
+            BufferId digitOffsets = graph.addBuffer("digitOffsets", wordsSize(histogramSize), Kind::Transient);
+            BufferId sortedKeys = last ? graph.addBuffer("sortedKeys", wordsSize(count), Kind::Output, keys)
+                                       : graph.addBuffer("sortedKeys", wordsSize(count), Kind::Transient);
+            BufferId sortedValues = last ? graph.addBuffer("sortedValues", wordsSize(count), Kind::Output, values)
+                                         : graph.addBuffer("sortedValues", wordsSize(count), Kind::Transient);
+
+            addStage(plan, "primRadixLocal", { { sourceKeys, false }, { sourceValues, false }, { localKeys, true },
+                                               { localValues, true }, { histogram, true }, { params, false } }, count);
+            addScan(plan, histogram, digitOffsets, histogramSize, false, false);
+            addStage(plan, "primRadixScatter", { { localKeys, false }, { localValues, false }, { histogram, false },
+                                                 { digitOffsets, false }, { sortedKeys, true }, { sortedValues, true },
+                                                 { params, false } }, count);
+            sourceKeys = sortedKeys;
+            sourceValues = sortedValues;
+        }
+    }
+    plan.graph->run();
+}
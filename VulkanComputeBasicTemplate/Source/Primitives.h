@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ComputeGraph.h"
+
+class Application;
+
+// Parallel building blocks over 32-bit unsigned integers. Every call is one ComputeGraph, so all
+// passes of a primitive run in one submission with the intermediates on the device. The graph of
+// the last call of each kind is kept and run again while the size and host pointers stay the same.
+// The kernels use subgroup arithmetic where the device supports it in compute shaders with at
+// least 16 invocations per subgroup, shared memory otherwise.
+class Primitives
+{
+public:
+    explicit Primitives(Application& app);
+
+    bool isSubgroupSupported() const { return m_subgroupSupported; }
+    bool usesSubgroups() const { return m_useSubgroups; }
+    // Disabling selects the shared memory kernels even where subgroups are supported
+    void setUseSubgroups(bool enabled);
+
+    // Wraps around like uint32_t addition
+    uint32_t reduce(const uint32_t* values, uint32_t count);
+    void exclusiveScan(const uint32_t* values, uint32_t* result, uint32_t count);
+    void inclusiveScan(const uint32_t* values, uint32_t* result, uint32_t count);
+    // Copies the values with a non-zero flag to result in their order and returns how many there
+    // are. result must hold count elements, the ones after the kept values are undefined.
+    uint32_t compact(const uint32_t* values, const uint32_t* flags, uint32_t* result, uint32_t count);
+    // Stable ascending sort by key in place, 4 bits per pass. Values move with their keys.
+    void sortPairs(uint32_t* keys, uint32_t* values, uint32_t count);
+
+private:
+    enum Operation { Reduce, ExclusiveScan, InclusiveScan, Compact, SortPairs, OperationCount };
+
+    struct Plan
+    {
+        std::unique_ptr<ComputeGraph> graph;
+        std::vector<const void*> pointers;
+        uint32_t count = 0;
+        bool subgroups = false;
+        // Host side of parameter buffers and scalar results, the deque keeps their addresses
+        std::deque<std::array<uint32_t, 4>> hostWords;
+        // Where reduce and compact read their single result
+        uint32_t* scalarResult = nullptr;
+    };
+
+    // The cached plan if it matches, otherwise an empty graph to add the stages to
+    Plan& getPlan(Operation operation, uint32_t count, const std::vector<const void*>& pointers, bool& build);
+    ComputeGraph::BufferId addHostWords(Plan& plan, const std::string& name, ComputeGraph::BufferKind kind,
+                                        std::array<uint32_t, 4> words, uint32_t** hostData = nullptr);
+    // One workgroup per block of blockSize elements, spilling into y past maxComputeWorkGroupCount[0]
+    void addStage(Plan& plan, const std::string& shaderName, const std::vector<ComputeGraph::Binding>& bindings, uint32_t count);
+    // Multi-level scan from in to out, the block totals of each level are scanned by the next
+    void addScan(Plan& plan, ComputeGraph::BufferId in, ComputeGraph::BufferId out, uint32_t count, bool inclusive, bool countNonZero);
+    void scan(Operation operation, const uint32_t* values, uint32_t* result, uint32_t count);
+
+    // Elements per workgroup of every kernel
+    static const uint32_t blockSize = 1024;
+
+    Application& m_app;
+    bool m_subgroupSupported = false;
+    bool m_useSubgroups = false;
+    Plan m_plans[OperationCount];
+};
@@ -0,0 +1,101 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <thread>
+
+Profiler& Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    : m_origin(std::chrono::steady_clock::now())
+{
+}
+
+uint64_t Profiler::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_origin).count();
+}
+
+void Profiler::recordCpu(const char* name, uint64_t startNs, uint64_t endNs)
+{
+    uint32_t threadId = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xffff);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push_back({ name, false, threadId, startNs, endNs - startNs });
+}
+
+void Profiler::recordGpu(const char* name, uint64_t startNs, uint64_t durationNs)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push_back({ name, true, 0, startNs, durationNs });
+}
+
+void Profiler::writeChromeTrace(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to write trace " << path << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Complete ("X") events in microseconds. CPU threads are pid 0, the GPU queue is pid 1.
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}";
+    file << std::fixed << std::setprecision(3);
+    for (const Event& event : m_events)
+    {
+        file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.gpu ? "gpu" : "cpu")
+             << "\",\"ph\":\"X\",\"pid\":" << (event.gpu ? 1 : 0) << ",\"tid\":" << event.threadId
+             << ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0 << "}";
+    }
+    file << "\n]}\n";
+}
+
+void Profiler::printSummary() const
+{
+    struct Summary
+    {
+        uint32_t count = 0;
+        uint64_t totalNs = 0;
+        uint64_t minNs = UINT64_MAX;
+        uint64_t maxNs = 0;
+    };
+
+    std::map<std::string, Summary> summaries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const Event& event : m_events)
+        {
+            Summary& summary = summaries[std::string(event.gpu ? "[GPU] " : "[CPU] ") + event.name];
+            ++summary.count;
+            summary.totalNs += event.durationNs;
+            summary.minNs = std::min(summary.minNs, event.durationNs);
+            summary.maxNs = std::max(summary.maxNs, event.durationNs);
+        }
+    }
+
+    std::cout << std::left << std::setw(40) << "Scope" << std::right << std::setw(8) << "Count"
+              << std::setw(14) << "Total ms" << std::setw(14) << "Mean us" << std::setw(14) << "Min us"
+              << std::setw(14) << "Max us" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto& entry : summaries)
+    {
+        const Summary& summary = entry.second;
+        std::cout << std::left << std::setw(40) << entry.first << std::right << std::setw(8) << summary.count
+                  << std::setw(14) << summary.totalNs / 1e6 << std::setw(14) << summary.totalNs / 1e3 / summary.count
+                  << std::setw(14) << summary.minNs / 1e3 << std::setw(14) << summary.maxNs / 1e3 << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+}
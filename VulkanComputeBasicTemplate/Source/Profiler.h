@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Collects CPU scopes and GPU timestamp ranges and writes them as a Chrome/Perfetto trace.
+// All instrumentation goes through the macros below, which expand to nothing unless the
+// project is built with VK_PROFILE (cmake -DVULKAN_COMPUTE_PROFILE=ON).
+class Profiler
+{
+public:
+    static Profiler& get();
+
+    // Nanoseconds since the profiler was first used
+    uint64_t now() const;
+
+    void recordCpu(const char* name, uint64_t startNs, uint64_t endNs);
+    void recordGpu(const char* name, uint64_t startNs, uint64_t durationNs);
+
+    void writeChromeTrace(const std::string& path) const;
+    void printSummary() const;
+
+private:
+    Profiler();
+
+    struct Event
+    {
+        const char* name;
+        bool gpu;
+        uint32_t threadId;
+        uint64_t startNs;
+        uint64_t durationNs;
+    };
+
+    std::chrono::steady_clock::time_point m_origin;
+    mutable std::mutex m_mutex;
+    std::vector<Event> m_events;
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name) : m_name(name), m_start(Profiler::get().now()) {}
+    ~ProfileScope() { Profiler::get().recordCpu(m_name, m_start, Profiler::get().now()); }
+
+private:
+    const char* m_name;
+    uint64_t m_start;
+};
+
+#ifdef VK_PROFILE
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
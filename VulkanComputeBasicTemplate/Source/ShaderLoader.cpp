@@ -6,10 +6,25 @@
 #include <fstream>
 #include <stdexcept>
 #include <sstream>
+#include <cstring>
+#include <future>
+
+#include "Profiler.h"
+#include "ThreadPool.h"
 
 #define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
 
-std::vector<VkShaderModule> shaderModuleCache = {};
+ThreadPool& ShaderLoader::getCompilePool()
+{
+    static ThreadPool compilePool;
+    return compilePool;
+}
+
+SpirvCache& ShaderLoader::getSpirvCache()
+{
+    static SpirvCache spirvCache("shader_cache", 64 * 1024 * 1024);
+    return spirvCache;
+}
 
 std::vector<char> readFile(const std::string& fileName)
 {
@@ -43,37 +58,68 @@ std::string readFileText(const std::string& fullpath)
     return stream.str();
 }
 
-VkPipelineShaderStageCreateInfo ShaderLoader::loadShader(VkDevice device, const std::string &file, VkShaderStageFlagBits stage)
+ShaderModuleRef ShaderLoader::loadShader(ShaderModuleCache& moduleCache, const std::string &file)
 {
     auto shaderSpv = readFile(file);
+    if (shaderSpv.size() % sizeof(uint32_t) != 0)
+        throw std::runtime_error("Invalid SPIR-V file: " + file);
+
+    std::vector<uint32_t> code(shaderSpv.size() / sizeof(uint32_t));
+    memcpy(code.data(), shaderSpv.data(), shaderSpv.size());
+    return moduleCache.get(code);
+}
+
+ShaderModuleRef ShaderLoader::compileAndLoadShader(ShaderModuleCache& moduleCache, const std::string &file, const std::string &sourceName,
+                                                   VkShaderStageFlagBits stage, const Macros& macros)
+{
+    PROFILE_SCOPE("compileAndLoadShader");
 
-    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
-    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCreateInfo.codeSize = shaderSpv.size();
-    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderSpv.data());
+    ShaderRequest request = { file, sourceName, stage, macros };
+    return moduleCache.get(compileToSpirv(request));
+}
 
-    VkShaderModule shaderModule;
-    VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shaderModule);
-    CHECK_VK_RESULT(result, "Failed to create Shader Module");
+std::vector<ShaderModuleRef> ShaderLoader::compileAndLoadShaders(ShaderModuleCache& moduleCache, const std::vector<ShaderRequest>& requests,
+                                                                 ThreadPool& pool)
+{
+    PROFILE_SCOPE("compileAndLoadShaders");
 
-    shaderModuleCache.push_back(shaderModule);
+    std::vector<ShaderModuleRef> modules(requests.size());
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        futures.push_back(pool.submit([&moduleCache, &requests, &modules, i]() {
+            modules[i] = moduleCache.get(compileToSpirv(requests[i]));
+        }));
+    }
 
-    VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {};
-    shaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStageCreateInfo.stage = stage;
-    shaderStageCreateInfo.module = shaderModule;
-    shaderStageCreateInfo.pName = "main";
+    // Every task references this frame, so all of them finish before the first error is rethrown
+    std::exception_ptr error;
+    for (std::future<void>& future : futures)
+    {
+        try
+        {
+            future.get();
+        }
+        catch (...)
+        {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
 
-    return shaderStageCreateInfo;
+    return modules;
 }
 
-VkPipelineShaderStageCreateInfo ShaderLoader::compileAndLoadShader(VkDevice device, const std::string &file, const std::string &sourceName,
-                                   VkShaderStageFlagBits stage)
+std::vector<uint32_t> ShaderLoader::compileToSpirv(const ShaderRequest& request)
 {
-    std::string shaderSource = readFileText(file);
+    PROFILE_SCOPE("compileToSpirv");
+
+    std::string shaderSource = readFileText(request.file);
 
     shaderc_shader_kind shaderKind;
-    switch (stage)
+    switch (request.stage)
     {
         case VK_SHADER_STAGE_VERTEX_BIT:
             shaderKind = shaderc_glsl_default_vertex_shader;
@@ -84,33 +130,40 @@ VkPipelineShaderStageCreateInfo ShaderLoader::compileAndLoadShader(VkDevice devi
         case VK_SHADER_STAGE_COMPUTE_BIT:
             shaderKind = shaderc_glsl_default_compute_shader;
             break;
+        default:
+            throw std::runtime_error("Unsupported shader stage");
     }
 
-    shaderc::Compiler compiler;
-    shaderc::CompileOptions options;
-
-    shaderc::SpvCompilationResult shaderRes = compiler.CompileGlslToSpv(shaderSource, shaderKind, sourceName.c_str(), options);
-    if (shaderRes.GetCompilationStatus() != shaderc_compilation_status_success)
-        throw std::runtime_error(shaderRes.GetErrorMessage());
+    // Describes every compile option that affects the output, keep in sync with the options below
+    std::string optionsKey = "kind=" + std::to_string(shaderKind) + ";options=default";
+    for (const auto& macro : request.macros)
+        optionsKey += ";-D" + macro.first + "=" + macro.second;
+    if (request.targetVulkanVersion != 0)
+        optionsKey += ";env=" + std::to_string(request.targetVulkanVersion);
+    std::string cacheKey = SpirvCache::makeKey(shaderSource, optionsKey);
 
-    std::vector<uint32_t> shaderSpv = { shaderRes.cbegin(), shaderRes.cend() };
+    std::vector<uint32_t> shaderSpv;
+    if (getSpirvCache().lookup(cacheKey, shaderSpv))
+        return shaderSpv;
 
-    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
-    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCreateInfo.codeSize = sizeof(uint32_t) * shaderSpv.size();
-    shaderModuleCreateInfo.pCode = shaderSpv.data();
+    {
+        PROFILE_SCOPE("shaderc compile");
 
-    VkShaderModule shaderModule;
-    VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shaderModule);
-    CHECK_VK_RESULT(result, "Failed to create Shader Module");
+        // Creating a compiler is not free, each thread reuses its own
+        thread_local shaderc::Compiler compiler;
+        shaderc::CompileOptions options;
+        for (const auto& macro : request.macros)
+            options.AddMacroDefinition(macro.first, macro.second);
+        if (request.targetVulkanVersion != 0)
+            options.SetTargetEnvironment(shaderc_target_env_vulkan, request.targetVulkanVersion);
 
-    shaderModuleCache.push_back(shaderModule);
+        shaderc::SpvCompilationResult shaderRes = compiler.CompileGlslToSpv(shaderSource, shaderKind, request.sourceName.c_str(), options);
+        if (shaderRes.GetCompilationStatus() != shaderc_compilation_status_success)
+            throw std::runtime_error(shaderRes.GetErrorMessage());
 
-    VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {};
-    shaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    shaderStageCreateInfo.stage = stage;
-    shaderStageCreateInfo.module = shaderModule;
-    shaderStageCreateInfo.pName = "main";
+        shaderSpv = { shaderRes.cbegin(), shaderRes.cend() };
+    }
 
-    return std::move(shaderStageCreateInfo);
+    getSpirvCache().store(cacheKey, shaderSpv);
+    return shaderSpv;
 }
@@ -2,11 +2,46 @@
 
 #include <vulkan/vulkan.h>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "ShaderModuleCache.h"
+#include "SpirvCache.h"
+
+class ThreadPool;
 
 class ShaderLoader
 {
 public:
-    static VkPipelineShaderStageCreateInfo loadShader(VkDevice device, const std::string &file, VkShaderStageFlagBits stage);
-    static VkPipelineShaderStageCreateInfo compileAndLoadShader(VkDevice device, const std::string& file, const std::string& sourceName, VkShaderStageFlagBits stage);
+    typedef std::vector<std::pair<std::string, std::string>> Macros;
+
+    // One GLSL file to compile, see compileAndLoadShaders
+    struct ShaderRequest
+    {
+        std::string file;
+        std::string sourceName;
+        VkShaderStageFlagBits stage;
+        Macros macros;
+        // VK_API_VERSION_1_1 or later for shaders that need SPIR-V 1.3, like subgroup operations.
+        // 0 keeps shaderc's default of Vulkan 1.0.
+        uint32_t targetVulkanVersion = 0;
+    };
+
+    // Modules come from the device's cache, identical SPIR-V shares one module
+    static ShaderModuleRef loadShader(ShaderModuleCache& moduleCache, const std::string &file);
+    static ShaderModuleRef compileAndLoadShader(ShaderModuleCache& moduleCache, const std::string& file, const std::string& sourceName, VkShaderStageFlagBits stage,
+                                                const Macros& macros = {});
+    // Compiles every request on the pool, results are in request order
+    static std::vector<ShaderModuleRef> compileAndLoadShaders(ShaderModuleCache& moduleCache, const std::vector<ShaderRequest>& requests,
+                                                              ThreadPool& pool);
+
+    // GLSL to SPIR-V through the SPIR-V cache. Safe to call from several threads, each keeps its own shaderc::Compiler.
+    static std::vector<uint32_t> compileToSpirv(const ShaderRequest& request);
+
+    // Shared by everything that compiles shaders at startup, one thread per hardware thread
+    static ThreadPool& getCompilePool();
+
+    // Compiled SPIR-V is cached on disk so unchanged shaders skip shaderc on the next start
+    static SpirvCache& getSpirvCache();
 
 };
@@ -0,0 +1,105 @@
+#include "ShaderModuleCache.h"
+
+#include <stdexcept>
+#include <iostream>
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+static uint64_t hashSpirv(const std::vector<uint32_t>& spirv)
+{
+    // FNV-1a over the words, SPIR-V is already a dense encoding
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint32_t word : spirv)
+    {
+        hash ^= word;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+ShaderModule::ShaderModule(VkDevice device, const std::vector<uint32_t>& spirv)
+    : m_device(device), m_spirv(spirv)
+{
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = sizeof(uint32_t) * spirv.size();
+    shaderModuleCreateInfo.pCode = spirv.data();
+
+    CHECK_VK_RESULT(vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &m_shaderModule),
+                    "Failed to create Shader Module");
+}
+
+ShaderModule::~ShaderModule()
+{
+    vkDestroyShaderModule(m_device, m_shaderModule, nullptr);
+}
+
+VkPipelineShaderStageCreateInfo ShaderModule::getStageCreateInfo(VkShaderStageFlagBits stage) const
+{
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {};
+    shaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStageCreateInfo.stage = stage;
+    shaderStageCreateInfo.module = m_shaderModule;
+    shaderStageCreateInfo.pName = "main";
+    return shaderStageCreateInfo;
+}
+
+void ShaderModuleCache::init(VkDevice device)
+{
+    m_device = device;
+}
+
+void ShaderModuleCache::destroy()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    prune();
+    // The modules destroy themselves, a leftover reference would outlive the device
+    if (!m_modules.empty())
+        std::cerr << m_modules.size() << " shader modules are still referenced" << std::endl;
+    m_modules.clear();
+    m_device = VK_NULL_HANDLE;
+}
+
+ShaderModuleRef ShaderModuleCache::get(const std::vector<uint32_t>& spirv)
+{
+    uint64_t hash = hashSpirv(spirv);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto range = m_modules.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        ShaderModuleRef module = it->second.lock();
+        if (module && module->m_spirv == spirv)
+        {
+            ++m_hits;
+            return module;
+        }
+    }
+
+    // Pipelines are rebuilt often, drop the entries of released modules before adding one
+    prune();
+
+    // Created under the lock, so two threads compiling the same shader still share one module
+    ShaderModuleRef module = std::make_shared<ShaderModule>(m_device, spirv);
+    m_modules.emplace(hash, module);
+    ++m_misses;
+    return module;
+}
+
+uint32_t ShaderModuleCache::getModuleCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    prune();
+    return static_cast<uint32_t>(m_modules.size());
+}
+
+void ShaderModuleCache::prune()
+{
+    for (auto it = m_modules.begin(); it != m_modules.end();)
+    {
+        if (it->second.expired())
+            it = m_modules.erase(it);
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// A VkShaderModule, destroyed together with the last reference to it
+class ShaderModule
+{
+public:
+    ShaderModule(VkDevice device, const std::vector<uint32_t>& spirv);
+    ~ShaderModule();
+
+    ShaderModule(const ShaderModule&) = delete;
+    ShaderModule& operator=(const ShaderModule&) = delete;
+
+    VkShaderModule get() const { return m_shaderModule; }
+    VkPipelineShaderStageCreateInfo getStageCreateInfo(VkShaderStageFlagBits stage) const;
+
+private:
+    friend class ShaderModuleCache;
+
+    VkDevice m_device;
+    VkShaderModule m_shaderModule = VK_NULL_HANDLE;
+    // Kept to tell modules with colliding hashes apart
+    std::vector<uint32_t> m_spirv;
+};
+
+typedef std::shared_ptr<ShaderModule> ShaderModuleRef;
+
+// Hands out one ShaderModule per distinct SPIR-V blob on a device. The cache only holds weak
+// references, pipelines keep the module alive for as long as they may be rebuilt from it.
+// All methods are thread-safe.
+class ShaderModuleCache
+{
+public:
+    void init(VkDevice device);
+    // Every module handed out must have been released by then
+    void destroy();
+
+    ShaderModuleRef get(const std::vector<uint32_t>& spirv);
+    VkDevice getDevice() const { return m_device; }
+
+    // Live modules, expired entries are pruned first
+    uint32_t getModuleCount();
+    uint32_t getHits() const { return m_hits; }
+    uint32_t getMisses() const { return m_misses; }
+
+private:
+    void prune();
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    std::mutex m_mutex;
+    std::unordered_multimap<uint64_t, std::weak_ptr<ShaderModule>> m_modules;
+    uint32_t m_hits = 0;
+    uint32_t m_misses = 0;
+};
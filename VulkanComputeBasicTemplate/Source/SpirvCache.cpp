@@ -0,0 +1,171 @@
+#include "SpirvCache.h"
+
+#include <shaderc/shaderc.h>
+#include <vulkan/vulkan.h>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static const uint32_t SPIRV_MAGIC = 0x07230203;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+SpirvCache::SpirvCache(const std::string& directory, uint64_t maxSizeBytes)
+    : m_directory(directory), m_maxSizeBytes(maxSizeBytes)
+{
+}
+
+void SpirvCache::setDirectory(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_directory = directory;
+}
+
+void SpirvCache::setMaxSize(uint64_t maxSizeBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxSizeBytes = maxSizeBytes;
+    evict();
+}
+
+std::string SpirvCache::makeKey(const std::string& source, const std::string& options)
+{
+    // shaderc has no runtime version query. The SPIR-V version it targets and the SDK header
+    // version it shipped with change whenever the compiler is upgraded.
+    unsigned int spvVersion = 0, spvRevision = 0;
+    shaderc_get_spv_version(&spvVersion, &spvRevision);
+    uint32_t headerVersion = VK_HEADER_VERSION;
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, source.data(), source.size());
+    hash = fnv1a(hash, options.data(), options.size());
+    hash = fnv1a(hash, &spvVersion, sizeof(spvVersion));
+    hash = fnv1a(hash, &spvRevision, sizeof(spvRevision));
+    hash = fnv1a(hash, &headerVersion, sizeof(headerVersion));
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return std::string(name) + "_" + std::to_string(source.size());
+}
+
+std::string SpirvCache::pathForKey(const std::string& key) const
+{
+    return (fs::path(m_directory) / (key + ".spv")).string();
+}
+
+bool SpirvCache::lookup(const std::string& key, std::vector<uint32_t>& spirv)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string path = pathForKey(key);
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    size_t fileSize = file.is_open() ? static_cast<size_t>(file.tellg()) : 0;
+    spirv.resize(fileSize / sizeof(uint32_t));
+    file.seekg(0);
+    if (spirv.empty() || fileSize % sizeof(uint32_t) != 0 ||
+        !file.read(reinterpret_cast<char*>(spirv.data()), fileSize) || spirv[0] != SPIRV_MAGIC)
+    {
+        // Missing or truncated blob, drop it so it gets rewritten
+        file.close();
+        std::error_code ec;
+        fs::remove(path, ec);
+        spirv.clear();
+        ++m_misses;
+        return false;
+    }
+    file.close();
+
+    // The modification time doubles as the last access time for LRU eviction
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    ++m_hits;
+    return true;
+}
+
+void SpirvCache::store(const std::string& key, const std::vector<uint32_t>& spirv)
+{
+    // The cache is an optimisation only, failing to write it must not fail the compile
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::error_code ec;
+    fs::create_directories(m_directory, ec);
+    if (ec)
+    {
+        std::cerr << "Failed to create SPIR-V cache directory " << m_directory << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    // Write to a temporary name first so a concurrent reader never sees a partial blob
+    std::string path = pathForKey(key);
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return;
+        file.write(reinterpret_cast<const char*>(spirv.data()), sizeof(uint32_t) * spirv.size());
+        if (!file)
+            return;
+    }
+    fs::rename(tmpPath, path, ec);
+    if (ec)
+    {
+        fs::remove(tmpPath, ec);
+        return;
+    }
+
+    evict();
+}
+
+void SpirvCache::evict()
+{
+    std::error_code ec;
+    if (!fs::is_directory(m_directory, ec))
+        return;
+
+    struct Entry
+    {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type lastUse;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t totalSize = 0;
+    for (const fs::directory_entry& dirEntry : fs::directory_iterator(m_directory, ec))
+    {
+        if (!dirEntry.is_regular_file(ec) || dirEntry.path().extension() != ".spv")
+            continue;
+
+        Entry entry = { dirEntry.path(), dirEntry.file_size(ec), dirEntry.last_write_time(ec) };
+        totalSize += entry.size;
+        entries.push_back(entry);
+    }
+
+    if (totalSize <= m_maxSizeBytes)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUse < b.lastUse;
+    });
+
+    for (const Entry& entry : entries)
+    {
+        if (totalSize <= m_maxSizeBytes)
+            break;
+        if (fs::remove(entry.path, ec))
+            totalSize -= entry.size;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Content-addressed on-disk store for compiled SPIR-V. Files are named after a hash of the
+// GLSL source, the compile options and the compiler version, so any change produces a new key.
+// The least recently used blobs are evicted once the directory grows beyond maxSizeBytes.
+// lookup and store may be called from several compile threads at once.
+class SpirvCache
+{
+public:
+    SpirvCache(const std::string& directory, uint64_t maxSizeBytes);
+
+    void setDirectory(const std::string& directory);
+    const std::string& getDirectory() const { return m_directory; }
+    void setMaxSize(uint64_t maxSizeBytes);
+
+    static std::string makeKey(const std::string& source, const std::string& options);
+
+    // Returns true and the blob if the key is cached. Read under the lock, so a concurrent
+    // store cannot evict the file in between.
+    bool lookup(const std::string& key, std::vector<uint32_t>& spirv);
+    void store(const std::string& key, const std::vector<uint32_t>& spirv);
+
+    uint32_t getHits() const { return m_hits; }
+    uint32_t getMisses() const { return m_misses; }
+
+private:
+    std::string pathForKey(const std::string& key) const;
+    void evict();
+
+    std::string m_directory;
+    uint64_t m_maxSizeBytes;
+    std::mutex m_mutex;
+
+    std::atomic<uint32_t> m_hits{ 0 };
+    std::atomic<uint32_t> m_misses{ 0 };
+};
@@ -0,0 +1,106 @@
+#include "StreamProcessor.h"
+
+#include <stdexcept>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+
+#include "Profiler.h"
+
+StreamProcessor::StreamProcessor(ComputeBackend& backend, uint32_t chunkElementCount, uint32_t depth)
+    : m_backend(backend), m_chunkElementCount(chunkElementCount), m_depth(depth)
+{
+    if (chunkElementCount == 0 || depth == 0)
+        throw std::runtime_error("Stream chunks and depth must not be empty");
+}
+
+StreamProcessor::Stats StreamProcessor::run(const std::string& inputPath, const std::string& outputPath)
+{
+    PROFILE_SCOPE("StreamProcessor::run");
+
+    std::ifstream input(inputPath, std::ios::binary | std::ios::ate);
+    if (!input.is_open())
+        throw std::runtime_error("Failed to read file: " + inputPath);
+    uint64_t inputSize = static_cast<uint64_t>(input.tellg());
+    input.seekg(0);
+    if (inputSize % sizeof(Calculation) != 0)
+        throw std::runtime_error("Input size is not a multiple of a Calculation: " + inputPath);
+
+    std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+    if (!output.is_open())
+        throw std::runtime_error("Failed to write file: " + outputPath);
+
+    // Chunks are recycled in submission order, so they also complete and get written in order
+    struct Chunk
+    {
+        std::vector<Calculation> calculations;
+        uint32_t elementCount = 0;
+        BatchHandle batch;
+        bool pending = false;
+    };
+    std::vector<Chunk> chunks(m_depth);
+
+    Stats stats;
+    uint64_t remaining = inputSize / sizeof(Calculation);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    auto retire = [&](Chunk& chunk) {
+        m_backend.waitBatch(chunk.batch);
+        chunk.pending = false;
+        output.write(reinterpret_cast<const char*>(chunk.calculations.data()), sizeof(Calculation) * chunk.elementCount);
+        if (!output)
+            throw std::runtime_error("Failed to write file: " + outputPath);
+    };
+
+    try
+    {
+        for (uint64_t chunkIndex = 0; remaining > 0; ++chunkIndex)
+        {
+            Chunk& chunk = chunks[chunkIndex % m_depth];
+            if (chunk.pending)
+                retire(chunk);
+
+            chunk.elementCount = static_cast<uint32_t>(std::min<uint64_t>(remaining, m_chunkElementCount));
+            if (chunk.calculations.size() < chunk.elementCount)
+            {
+                chunk.calculations.resize(m_chunkElementCount);
+                stats.peakHostBytes += sizeof(Calculation) * m_chunkElementCount;
+            }
+
+            {
+                PROFILE_SCOPE("read chunk");
+                input.read(reinterpret_cast<char*>(chunk.calculations.data()), sizeof(Calculation) * chunk.elementCount);
+                if (!input)
+                    throw std::runtime_error("Failed to read file: " + inputPath);
+            }
+
+            chunk.batch = m_backend.computeBatchAsync(chunk.calculations.data(), chunk.elementCount);
+            chunk.pending = true;
+
+            remaining -= chunk.elementCount;
+            stats.bytes += sizeof(Calculation) * chunk.elementCount;
+            ++stats.chunks;
+        }
+
+        for (uint64_t i = 0; i < m_depth; ++i)
+        {
+            Chunk& chunk = chunks[(stats.chunks + i) % m_depth];
+            if (chunk.pending)
+                retire(chunk);
+        }
+    }
+    catch (...)
+    {
+        // The backend may still write into the chunk buffers
+        for (Chunk& chunk : chunks)
+        {
+            if (chunk.pending)
+                m_backend.waitBatch(chunk.batch);
+        }
+        throw;
+    }
+
+    output.close();
+    stats.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ComputeBackend.h"
+
+// Runs a file of Calculations through a backend in fixed-size chunks and writes the results to
+// another file as they complete. Reading chunk n + 1 and writing chunk n - depth + 1 overlap the
+// work on the chunks in between, and host memory stays at depth chunks however large the file is.
+//
+// For the Vulkan backend each chunk in flight needs a frame, set the frames in flight to at least depth.
+class StreamProcessor
+{
+public:
+    struct Stats
+    {
+        uint64_t bytes = 0;
+        uint64_t chunks = 0;
+        double seconds = 0.0;
+        // Chunk buffers on the host, the only allocation that scales with the settings
+        uint64_t peakHostBytes = 0;
+
+        double getGigabytesPerSecond() const { return seconds > 0.0 ? bytes / seconds / 1e9 : 0.0; }
+    };
+
+    StreamProcessor(ComputeBackend& backend, uint32_t chunkElementCount = 1 << 20, uint32_t depth = 3);
+
+    // Both files hold tightly packed Calculations, the output has res filled in
+    Stats run(const std::string& inputPath, const std::string& outputPath);
+
+private:
+    ComputeBackend& m_backend;
+    uint32_t m_chunkElementCount;
+    uint32_t m_depth;
+};
@@ -0,0 +1,225 @@
+#include "SubmissionRing.h"
+
+#include <limits>
+#include <stdexcept>
+
+#define CHECK_VK_RESULT(result, str) if ((result) != VK_SUCCESS) throw std::runtime_error((str))
+
+void SubmissionRing::init(VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, uint32_t depth)
+{
+    init(device, queue, queueFamilyIndex, VK_NULL_HANDLE, queueFamilyIndex, depth);
+}
+
+void SubmissionRing::init(VkDevice device, VkQueue queue, uint32_t queueFamilyIndex,
+                          VkQueue transferQueue, uint32_t transferQueueFamilyIndex, uint32_t depth)
+{
+    m_device = device;
+    m_queue = queue;
+    m_transferQueue = transferQueue;
+    m_nextSlot = 0;
+
+    m_commandPool = createCommandPool(queueFamilyIndex);
+    std::vector<VkCommandBuffer> commandBuffers = allocateCommandBuffers(m_commandPool, depth);
+
+    // Fences start signaled so the first acquire of every slot does not block
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    m_slots.resize(depth);
+    for (uint32_t i = 0; i < depth; ++i)
+    {
+        m_slots[i].commandBuffer = commandBuffers[i];
+        CHECK_VK_RESULT(vkCreateFence(m_device, &fenceCreateInfo, nullptr, &m_slots[i].fence),
+                        "Failed to create fence");
+    }
+
+    if (m_transferQueue == VK_NULL_HANDLE)
+        return;
+
+    m_transferCommandPool = createCommandPool(transferQueueFamilyIndex);
+    std::vector<VkCommandBuffer> transferCommandBuffers = allocateCommandBuffers(m_transferCommandPool, depth * 2);
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < depth; ++i)
+    {
+        m_slots[i].uploadCommandBuffer = transferCommandBuffers[i * 2];
+        m_slots[i].downloadCommandBuffer = transferCommandBuffers[i * 2 + 1];
+        CHECK_VK_RESULT(vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_slots[i].uploadFinished),
+                        "Failed to create semaphore");
+        CHECK_VK_RESULT(vkCreateSemaphore(m_device, &semaphoreCreateInfo, nullptr, &m_slots[i].computeFinished),
+                        "Failed to create semaphore");
+    }
+}
+
+VkCommandPool SubmissionRing::createCommandPool(uint32_t queueFamilyIndex)
+{
+    // Command buffers are reset one at a time when their slot comes around again
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+
+    VkCommandPool commandPool;
+    CHECK_VK_RESULT(vkCreateCommandPool(m_device, &commandPoolCreateInfo, NULL, &commandPool),
+                    "Failed to create command pool");
+    return commandPool;
+}
+
+std::vector<VkCommandBuffer> SubmissionRing::allocateCommandBuffers(VkCommandPool commandPool, uint32_t count)
+{
+    std::vector<VkCommandBuffer> commandBuffers(count);
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = commandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = count;
+    CHECK_VK_RESULT(vkAllocateCommandBuffers(m_device, &commandBufferAllocateInfo, commandBuffers.data()),
+                    "Failed to allocate command buffers");
+    return commandBuffers;
+}
+
+void SubmissionRing::destroy()
+{
+    if (m_device == VK_NULL_HANDLE)
+        return;
+
+    waitAll();
+    for (Slot& slot : m_slots)
+    {
+        vkDestroyFence(m_device, slot.fence, nullptr);
+        if (slot.uploadFinished != VK_NULL_HANDLE)
+            vkDestroySemaphore(m_device, slot.uploadFinished, nullptr);
+        if (slot.computeFinished != VK_NULL_HANDLE)
+            vkDestroySemaphore(m_device, slot.computeFinished, nullptr);
+    }
+    m_slots.clear();
+
+    vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+    m_commandPool = VK_NULL_HANDLE;
+    if (m_transferCommandPool != VK_NULL_HANDLE)
+        vkDestroyCommandPool(m_device, m_transferCommandPool, nullptr);
+    m_transferCommandPool = VK_NULL_HANDLE;
+    m_transferQueue = VK_NULL_HANDLE;
+}
+
+uint32_t SubmissionRing::acquire()
+{
+    uint32_t slotIndex = m_nextSlot;
+    m_nextSlot = (m_nextSlot + 1) % getDepth();
+
+    Slot& slot = m_slots[slotIndex];
+    CHECK_VK_RESULT(vkWaitForFences(m_device, 1, &slot.fence, VK_TRUE, std::numeric_limits<uint64_t>::max()),
+                    "Failed to wait for fence");
+    return slotIndex;
+}
+
+SubmitHandle SubmissionRing::submit(uint32_t slotIndex)
+{
+    Slot& slot = m_slots[slotIndex];
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &slot.commandBuffer;
+
+    CHECK_VK_RESULT(vkResetFences(m_device, 1, &slot.fence),
+                    "Failed to reset fence");
+    CHECK_VK_RESULT(vkQueueSubmit(m_queue, 1, &submitInfo, slot.fence),
+                    "Failed to submit queue");
+
+    return finishSubmit(slotIndex);
+}
+
+SubmitHandle SubmissionRing::submitWithTransfers(uint32_t slotIndex)
+{
+    if (!hasTransferQueue())
+        return submit(slotIndex);
+
+    Slot& slot = m_slots[slotIndex];
+
+    VkSubmitInfo uploadSubmitInfo = {};
+    uploadSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    uploadSubmitInfo.commandBufferCount = 1;
+    uploadSubmitInfo.pCommandBuffers = &slot.uploadCommandBuffer;
+    uploadSubmitInfo.signalSemaphoreCount = 1;
+    uploadSubmitInfo.pSignalSemaphores = &slot.uploadFinished;
+
+    // The compute queue only waits for the upload where the dispatch starts
+    VkPipelineStageFlags computeWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkSubmitInfo computeSubmitInfo = {};
+    computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    computeSubmitInfo.waitSemaphoreCount = 1;
+    computeSubmitInfo.pWaitSemaphores = &slot.uploadFinished;
+    computeSubmitInfo.pWaitDstStageMask = &computeWaitStage;
+    computeSubmitInfo.commandBufferCount = 1;
+    computeSubmitInfo.pCommandBuffers = &slot.commandBuffer;
+    computeSubmitInfo.signalSemaphoreCount = 1;
+    computeSubmitInfo.pSignalSemaphores = &slot.computeFinished;
+
+    VkPipelineStageFlags downloadWaitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    VkSubmitInfo downloadSubmitInfo = {};
+    downloadSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    downloadSubmitInfo.waitSemaphoreCount = 1;
+    downloadSubmitInfo.pWaitSemaphores = &slot.computeFinished;
+    downloadSubmitInfo.pWaitDstStageMask = &downloadWaitStage;
+    downloadSubmitInfo.commandBufferCount = 1;
+    downloadSubmitInfo.pCommandBuffers = &slot.downloadCommandBuffer;
+
+    CHECK_VK_RESULT(vkResetFences(m_device, 1, &slot.fence),
+                    "Failed to reset fence");
+    CHECK_VK_RESULT(vkQueueSubmit(m_transferQueue, 1, &uploadSubmitInfo, VK_NULL_HANDLE),
+                    "Failed to submit upload");
+    CHECK_VK_RESULT(vkQueueSubmit(m_queue, 1, &computeSubmitInfo, VK_NULL_HANDLE),
+                    "Failed to submit queue");
+    // The download is last in the chain, its fence retires the whole slot
+    CHECK_VK_RESULT(vkQueueSubmit(m_transferQueue, 1, &downloadSubmitInfo, slot.fence),
+                    "Failed to submit download");
+
+    return finishSubmit(slotIndex);
+}
+
+SubmitHandle SubmissionRing::finishSubmit(uint32_t slotIndex)
+{
+    Slot& slot = m_slots[slotIndex];
+    slot.submitId = m_nextSubmitId++;
+
+    SubmitHandle handle;
+    handle.slot = slotIndex;
+    handle.id = slot.submitId;
+    return handle;
+}
+
+bool SubmissionRing::isComplete(const SubmitHandle& handle) const
+{
+    const Slot& slot = m_slots[handle.slot];
+
+    // The slot has been reused, which only happens after its earlier submission finished
+    if (slot.submitId != handle.id)
+        return true;
+
+    return vkGetFenceStatus(m_device, slot.fence) == VK_SUCCESS;
+}
+
+void SubmissionRing::wait(const SubmitHandle& handle) const
+{
+    const Slot& slot = m_slots[handle.slot];
+    if (slot.submitId != handle.id)
+        return;
+
+    CHECK_VK_RESULT(vkWaitForFences(m_device, 1, &slot.fence, VK_TRUE, std::numeric_limits<uint64_t>::max()),
+                    "Failed to wait for fence");
+}
+
+void SubmissionRing::waitAll() const
+{
+    std::vector<VkFence> fences;
+    for (const Slot& slot : m_slots)
+        fences.push_back(slot.fence);
+
+    if (!fences.empty())
+        CHECK_VK_RESULT(vkWaitForFences(m_device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max()),
+                        "Failed to wait for fences");
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Identifies one submission made through a SubmissionRing
+struct SubmitHandle
+{
+    uint32_t slot = 0;
+    uint64_t id = 0;
+};
+
+// A ring of command buffers, each paired with a fence that is recycled instead of recreated.
+// Up to depth submissions can be in flight, acquire() only blocks once the ring wraps around
+// onto a slot whose previous submission is still running on the GPU.
+//
+// With a transfer queue from a different family, every slot also has an upload and a download
+// command buffer. submitWithTransfers chains upload -> compute -> download across the two queues
+// with semaphores, so copies of one slot overlap the dispatch of another.
+class SubmissionRing
+{
+public:
+    void init(VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, uint32_t depth);
+    void init(VkDevice device, VkQueue queue, uint32_t queueFamilyIndex,
+              VkQueue transferQueue, uint32_t transferQueueFamilyIndex, uint32_t depth);
+    void destroy();
+
+    // Waits for the next slot to retire and returns its index, the slot's command buffers are then free to record
+    uint32_t acquire();
+    VkCommandBuffer getCommandBuffer(uint32_t slot) const { return m_slots[slot].commandBuffer; }
+    VkCommandBuffer getUploadCommandBuffer(uint32_t slot) const { return m_slots[slot].uploadCommandBuffer; }
+    VkCommandBuffer getDownloadCommandBuffer(uint32_t slot) const { return m_slots[slot].downloadCommandBuffer; }
+    bool hasTransferQueue() const { return m_transferQueue != VK_NULL_HANDLE; }
+
+    // Submits only the compute command buffer
+    SubmitHandle submit(uint32_t slot);
+    // Submits upload, compute and download, the fence signals once the download finished
+    SubmitHandle submitWithTransfers(uint32_t slot);
+
+    bool isComplete(const SubmitHandle& handle) const;
+    void wait(const SubmitHandle& handle) const;
+    void waitAll() const;
+
+    uint32_t getDepth() const { return static_cast<uint32_t>(m_slots.size()); }
+
+private:
+    struct Slot
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        uint64_t submitId = 0;
+
+        // Only with a transfer queue
+        VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer downloadCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore uploadFinished = VK_NULL_HANDLE;
+        VkSemaphore computeFinished = VK_NULL_HANDLE;
+    };
+
+    VkCommandPool createCommandPool(uint32_t queueFamilyIndex);
+    std::vector<VkCommandBuffer> allocateCommandBuffers(VkCommandPool commandPool, uint32_t count);
+    SubmitHandle finishSubmit(uint32_t slot);
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkQueue m_queue = VK_NULL_HANDLE;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
+    std::vector<Slot> m_slots;
+    uint32_t m_nextSlot = 0;
+    uint64_t m_nextSubmitId = 1;
+};
@@ -0,0 +1,55 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (uint32_t i = 0; i < threadCount; ++i)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_all();
+
+    // Queued tasks still run, their futures would otherwise never become ready
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+    std::packaged_task<void()> packagedTask(std::move(task));
+    std::future<void> future = packagedTask.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(packagedTask));
+    }
+    m_condition.notify_one();
+    return future;
+}
+
+void ThreadPool::workerLoop()
+{
+    for (;;)
+    {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty())
+                return;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
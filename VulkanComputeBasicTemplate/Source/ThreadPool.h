@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads fed from one FIFO queue
+class ThreadPool
+{
+public:
+    // 0 uses one thread per hardware thread
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Exceptions thrown by the task are rethrown from the future's get()
+    std::future<void> submit(std::function<void()> task);
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_workers.size()); }
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::packaged_task<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+};
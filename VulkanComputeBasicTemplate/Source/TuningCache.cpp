@@ -0,0 +1,75 @@
+#include "TuningCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+std::string TuningCache::makeKey(const VkPhysicalDeviceProperties& deviceProperties)
+{
+    // The pipeline cache UUID changes with the device and the driver build
+    char key[2 * VK_UUID_SIZE + 16];
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+        snprintf(key + 2 * i, 3, "%02x", deviceProperties.pipelineCacheUUID[i]);
+    snprintf(key + 2 * VK_UUID_SIZE, 16, "-%08x", deviceProperties.driverVersion);
+    return key;
+}
+
+bool TuningCache::lookup(const VkPhysicalDeviceProperties& deviceProperties, Entry& entry) const
+{
+    std::ifstream file(m_path);
+    if (!file.is_open())
+        return false;
+
+    // One "key workgroupSize elementsPerInvocation" line per device
+    std::string key = makeKey(deviceProperties);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string lineKey;
+        Entry lineEntry;
+        if (stream >> lineKey >> lineEntry.workgroupSize >> lineEntry.elementsPerInvocation && lineKey == key &&
+            lineEntry.workgroupSize > 0 && lineEntry.elementsPerInvocation > 0)
+        {
+            entry = lineEntry;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TuningCache::store(const VkPhysicalDeviceProperties& deviceProperties, const Entry& entry)
+{
+    std::string key = makeKey(deviceProperties);
+
+    // Keep the other devices' lines
+    std::vector<std::string> lines;
+    std::ifstream in(m_path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.compare(0, key.size() + 1, key + " ") != 0)
+            lines.push_back(line);
+    }
+    in.close();
+    lines.push_back(key + " " + std::to_string(entry.workgroupSize) + " " + std::to_string(entry.elementsPerInvocation));
+
+    // Write next to the target and rename, like PipelineCache::save
+    std::string tmpPath = m_path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::trunc);
+    if (!out.is_open())
+    {
+        std::cerr << "Failed to write tuning cache " << m_path << std::endl;
+        return;
+    }
+    for (const std::string& l : lines)
+        out << l << "\n";
+    out.close();
+
+    std::remove(m_path.c_str());
+    if (std::rename(tmpPath.c_str(), m_path.c_str()) != 0)
+        std::cerr << "Failed to write tuning cache " << m_path << std::endl;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+// Kernel parameters the autotuner found fastest, keyed by device and driver so a driver
+// update or a different GPU triggers a new tuning run
+class TuningCache
+{
+public:
+    struct Entry
+    {
+        uint32_t workgroupSize = 0;
+        uint32_t elementsPerInvocation = 0;
+    };
+
+    explicit TuningCache(const std::string& path) : m_path(path) {}
+
+    bool lookup(const VkPhysicalDeviceProperties& deviceProperties, Entry& entry) const;
+    void store(const VkPhysicalDeviceProperties& deviceProperties, const Entry& entry);
+
+private:
+    static std::string makeKey(const VkPhysicalDeviceProperties& deviceProperties);
+
+    std::string m_path;
+};
@@ -1,14 +1,560 @@
 #include <stdexcept>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "Application.h"
+#include "ComputeClient.h"
+#include "ComputeGraph.h"
+#include "ComputeServer.h"
+#include "CpuBackend.h"
+#include "CrossCheckBackend.h"
+#include "DeviceGroup.h"
+#include "Primitives.h"
+#include "StreamProcessor.h"
 
-int main()
+// out = 2 * (the positive elements of x). The filter's count sizes the last pass on the device,
+// the host only sees it afterwards.
+static void runIndirectExample(Application& app, const std::vector<float>& x)
 {
+    typedef ComputeGraph::BufferKind Kind;
+    uint32_t elementCount = static_cast<uint32_t>(x.size());
+    VkDeviceSize size = sizeof(float) * elementCount;
+    uint32_t args[4] = { 0, 1, 1, 0 };
+    uint32_t count = 0;
+    std::vector<float> out(elementCount);
+
+    ComputeGraph graph(app);
+    auto xBuffer = graph.addBuffer("x", size, Kind::Input, const_cast<float*>(x.data()));
+    auto argsBuffer = graph.addBuffer("args", sizeof(args), Kind::Input, args);
+    auto filtered = graph.addBuffer("filtered", size, Kind::Transient);
+    auto countBuffer = graph.addBuffer("count", sizeof(count), Kind::Output, &count);
+    auto outBuffer = graph.addBuffer("out", size, Kind::Output, out.data());
+
+    graph.addStage("../Shaders/graphFilter.glsl", { { xBuffer, false }, { filtered, true }, { argsBuffer, true } },
+                   (elementCount + 255) / 256);
+    graph.addStage("../Shaders/graphDispatchArgs.glsl", { { argsBuffer, true }, { countBuffer, true } }, 1);
+    graph.addIndirectStage("../Shaders/graphScaleIndirect.glsl", { { filtered, false }, { argsBuffer, false }, { outBuffer, true } },
+                           argsBuffer);
+    graph.run();
+
+    // The filter appends in any order
+    std::vector<float> expected;
+    for (float value : x)
+    {
+        if (value > 0.f)
+            expected.push_back(2.f * value);
+    }
+    if (count != expected.size())
+        throw std::runtime_error("Indirect graph kept the wrong number of elements");
+    std::vector<float> actual(out.begin(), out.begin() + count);
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    if (actual != expected)
+        throw std::runtime_error("Indirect graph results do not match the CPU reference");
+
+    std::cout << "Indirect graph: kept " << count << " of " << elementCount << " elements in one submission" << std::endl;
+}
+
+// c = a + b over 16-bit floats and 8-bit integers where the device can store them, a quarter of
+// the memory traffic of 32-bit floats for the int8 case
+static void runPackedExample(Application& app, uint32_t elementCount)
+{
+    typedef ComputeGraph::BufferKind Kind;
+    typedef BufferLayout::Half Half;
+    const Application::StorageFeatures& features = app.getStorageFeatures();
+    uint32_t groupCount = (elementCount + 255) / 256;
+
+    if (features.storage16Bit)
+    {
+        std::vector<Half> a(elementCount), b(elementCount), c(elementCount);
+        for (uint32_t i = 0; i < elementCount; ++i)
+        {
+            a[i] = Half(static_cast<float>(i % 1000) * 0.01f);
+            b[i] = Half(static_cast<float>(i % 7) - 3.f);
+        }
+
+        ComputeGraph graph(app);
+        graph.setShaderOptions({ { "ELEMENT_HALF", "1" } });
+        auto aBuffer = graph.addTypedBuffer("a", elementCount, Kind::Input, a.data());
+        auto bBuffer = graph.addTypedBuffer("b", elementCount, Kind::Input, b.data());
+        auto cBuffer = graph.addTypedBuffer("c", elementCount, Kind::Output, c.data());
+        graph.addStage("../Shaders/graphAddPacked.glsl", { { aBuffer, false }, { bBuffer, false }, { cBuffer, true } }, groupCount);
+        graph.run();
+
+        // The device may round the 32-bit sum to 16 bits in either direction
+        for (uint32_t i = 0; i < elementCount; ++i)
+        {
+            float expected = static_cast<float>(Half(static_cast<float>(a[i]) + static_cast<float>(b[i])));
+            if (std::fabs(static_cast<float>(c[i]) - expected) > std::fabs(expected) * (1.f / 1024.f) + 1e-7f)
+                throw std::runtime_error("16-bit graph results do not match the CPU reference");
+        }
+        std::cout << "Packed graph: 16-bit float results match" << std::endl;
+    }
+    else
+    {
+        std::cout << "Packed graph: no 16-bit storage" << std::endl;
+    }
+
+    if (features.storage8Bit)
+    {
+        std::vector<int8_t> a(elementCount), b(elementCount), c(elementCount);
+        for (uint32_t i = 0; i < elementCount; ++i)
+        {
+            a[i] = static_cast<int8_t>(i);
+            b[i] = static_cast<int8_t>(i * 7);
+        }
+
+        ComputeGraph graph(app);
+        graph.setShaderOptions({ { "ELEMENT_INT8", "1" } });
+        auto aBuffer = graph.addTypedBuffer("a", elementCount, Kind::Input, a.data());
+        auto bBuffer = graph.addTypedBuffer("b", elementCount, Kind::Input, b.data());
+        auto cBuffer = graph.addTypedBuffer("c", elementCount, Kind::Output, c.data());
+        graph.addStage("../Shaders/graphAddPacked.glsl", { { aBuffer, false }, { bBuffer, false }, { cBuffer, true } }, groupCount);
+        graph.run();
+
+        for (uint32_t i = 0; i < elementCount; ++i)
+        {
+            if (c[i] != static_cast<int8_t>(a[i] + b[i]))
+                throw std::runtime_error("8-bit graph results do not match the CPU reference");
+        }
+        std::cout << "Packed graph: 8-bit integer results match" << std::endl;
+    }
+    else
+    {
+        std::cout << "Packed graph: no 8-bit storage" << std::endl;
+    }
+}
+
+// out = ((x + y) * (x * y) + x) * y as a five stage graph, the intermediates never leave the device
+static void runGraphExample(uint32_t elementCount)
+{
+    std::vector<float> x(elementCount), y(elementCount), out(elementCount);
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        x[i] = static_cast<float>(i % 1000) * 0.001f;
+        y[i] = static_cast<float>(i % 7) + 1.f;
+    }
+
+    Application app;
+    app.setup();
+    {
+        typedef ComputeGraph::BufferKind Kind;
+        VkDeviceSize size = sizeof(float) * elementCount;
+        uint32_t groupCount = (elementCount + 255) / 256;
+
+        ComputeGraph graph(app);
+        auto xBuffer = graph.addBuffer("x", size, Kind::Input, x.data());
+        auto yBuffer = graph.addBuffer("y", size, Kind::Input, y.data());
+        auto sum = graph.addBuffer("sum", size, Kind::Transient);
+        auto product = graph.addBuffer("product", size, Kind::Transient);
+        auto c = graph.addBuffer("c", size, Kind::Transient);
+        auto d = graph.addBuffer("d", size, Kind::Transient);
+        auto outBuffer = graph.addBuffer("out", size, Kind::Output, out.data());
+
+        graph.addStage("../Shaders/graphAdd.glsl", { { xBuffer, false }, { yBuffer, false }, { sum, true } }, groupCount);
+        graph.addStage("../Shaders/graphMul.glsl", { { xBuffer, false }, { yBuffer, false }, { product, true } }, groupCount);
+        graph.addStage("../Shaders/graphMul.glsl", { { sum, false }, { product, false }, { c, true } }, groupCount);
+        graph.addStage("../Shaders/graphAdd.glsl", { { c, false }, { xBuffer, false }, { d, true } }, groupCount);
+        graph.addStage("../Shaders/graphMul.glsl", { { d, false }, { yBuffer, false }, { outBuffer, true } }, groupCount);
+
+        graph.compile();
+        graph.run();
+
+        std::cout << "Graph: 5 stages in " << graph.getLevelCount() << " levels, " << graph.getBarrierCount() << " barriers, "
+                  << graph.getTransientAllocationCount() << " buffers for 4 intermediates" << std::endl;
+    }
+    {
+        std::vector<float> signedX(elementCount);
+        for (uint32_t i = 0; i < elementCount; ++i)
+            signedX[i] = static_cast<float>(i % 5) - 2.f;
+        runIndirectExample(app, signedX);
+    }
+    runPackedExample(app, elementCount);
+    app.shutdown();
+
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        float expected = ((x[i] + y[i]) * (x[i] * y[i]) + x[i]) * y[i];
+        if (std::fabs(out[i] - expected) > 1e-4f * std::fabs(expected) + 1e-6f)
+            throw std::runtime_error("Graph results do not match the CPU reference");
+    }
+    std::cout << "Graph results match" << std::endl;
+}
+
+// Every primitive against its standard library counterpart, with the subgroup kernels and the
+// shared memory kernels where the device has both
+static void checkPrimitives(Primitives& primitives, uint32_t elementCount)
+{
+    std::vector<uint32_t> values(elementCount), flags(elementCount), keys(elementCount), order(elementCount);
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        values[i] = seed >> 24;
+        flags[i] = (seed >> 8) & 1;
+        keys[i] = seed;
+        order[i] = i;
+    }
+
+    std::vector<uint32_t> expectedExclusive(elementCount), expectedInclusive(elementCount), expectedKept;
+    uint32_t expectedSum = std::accumulate(values.begin(), values.end(), 0u);
+    std::exclusive_scan(values.begin(), values.end(), expectedExclusive.begin(), 0u);
+    std::inclusive_scan(values.begin(), values.end(), expectedInclusive.begin());
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        if (flags[i] != 0)
+            expectedKept.push_back(values[i]);
+    }
+    std::vector<uint32_t> expectedOrder = order;
+    std::stable_sort(expectedOrder.begin(), expectedOrder.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+    std::vector<bool> modes = { false };
+    if (primitives.isSubgroupSupported())
+        modes.push_back(true);
+
+    for (bool subgroups : modes)
+    {
+        primitives.setUseSubgroups(subgroups);
+        std::vector<uint32_t> result(elementCount);
+        std::string name = std::string(subgroups ? "subgroup" : "shared memory") + " kernels at " + std::to_string(elementCount) + " elements";
+
+        if (primitives.reduce(values.data(), elementCount) != expectedSum)
+            throw std::runtime_error("Reduce does not match the CPU reference with " + name);
+
+        primitives.exclusiveScan(values.data(), result.data(), elementCount);
+        if (result != expectedExclusive)
+            throw std::runtime_error("Exclusive scan does not match the CPU reference with " + name);
+
+        primitives.inclusiveScan(values.data(), result.data(), elementCount);
+        if (result != expectedInclusive)
+            throw std::runtime_error("Inclusive scan does not match the CPU reference with " + name);
+
+        uint32_t kept = primitives.compact(values.data(), flags.data(), result.data(), elementCount);
+        if (kept != expectedKept.size() || !std::equal(expectedKept.begin(), expectedKept.end(), result.begin()))
+            throw std::runtime_error("Compaction does not match the CPU reference with " + name);
+
+        std::vector<uint32_t> sortedKeys = keys, sortedOrder = order;
+        primitives.sortPairs(sortedKeys.data(), sortedOrder.data(), elementCount);
+        if (sortedOrder != expectedOrder)
+            throw std::runtime_error("Radix sort does not match the CPU reference with " + name);
+
+        std::cout << "Primitives match the CPU reference with " << name << std::endl;
+    }
+}
+
+static void runPrimitivesExample(uint32_t elementCount, bool elementCountGiven)
+{
+    // Without a size the padding paths are covered too: a single element, a single partial
+    // block, a partial last block and a second scan level with a partial block
+    std::vector<uint32_t> sizes = { elementCount };
+    if (!elementCountGiven)
+        sizes = { 1, 1000, 1025, 1024 * 1024 + 7 };
+
+    Application app;
+    app.setup();
+    {
+        Primitives primitives(app);
+        for (uint32_t size : sizes)
+            checkPrimitives(primitives, size);
+    }
+    app.shutdown();
+}
+
+static void runStream(ComputeBackend& backend, const std::string& inputPath, const std::string& outputPath,
+                      uint32_t chunkElementCount, uint32_t depth)
+{
+    backend.setup();
+    StreamProcessor stream(backend, chunkElementCount, depth);
+    StreamProcessor::Stats stats = stream.run(inputPath, outputPath);
+    backend.shutdown();
+
+    std::cout << "Streamed " << stats.bytes / (1024.0 * 1024.0) << " MiB in " << stats.chunks << " chunks on " << backend.getName()
+              << ": " << stats.getGigabytesPerSecond() << " GB/s, " << stats.peakHostBytes / (1024.0 * 1024.0)
+              << " MiB of host chunk buffers" << std::endl;
+}
+
+static ComputeServer* servingServer = nullptr;
+
+static void stopServing(int)
+{
+    if (servingServer != nullptr)
+        servingServer->stop();
+}
+
+// Sets the backend up once and computes the jobs of every client until SIGINT, SIGTERM or --stop
+static void runServer(ComputeBackend& backend, const std::string& socketPath)
+{
+    backend.setup();
+    ComputeServer::Stats stats;
+    {
+        ComputeServer server(backend, socketPath);
+        servingServer = &server;
+        std::signal(SIGINT, stopServing);
+        std::signal(SIGTERM, stopServing);
+        std::cout << "Serving " << backend.getName() << " on " << socketPath << std::endl;
+
+        try
+        {
+            server.run();
+        }
+        catch (...)
+        {
+            servingServer = nullptr;
+            throw;
+        }
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        servingServer = nullptr;
+        stats = server.getStats();
+    }
+    backend.shutdown();
+
+    std::cout << "Served " << stats.jobs << " jobs from " << stats.connections << " connections in " << stats.batches
+              << " batches, up to " << stats.peakBatchJobs << " jobs per batch" << std::endl;
+    if (stats.failedJobs > 0)
+        std::cout << stats.failedJobs << " jobs failed in the backend" << std::endl;
+}
+
+// Load generator: every connection runs jobs of elementCount Calculations back to back and checks
+// the results, so concurrent jobs meet at the server and share batches
+static void runClients(const std::string& socketPath, uint32_t connectionCount, uint32_t elementCount)
+{
+    const uint32_t jobsPerConnection = 100;
+    std::vector<std::vector<double>> latencies(connectionCount);
+    std::vector<std::string> errors(connectionCount);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t connection = 0; connection < connectionCount; ++connection)
+    {
+        threads.emplace_back([&, connection]
+        {
+            try
+            {
+                ComputeClient client(socketPath, elementCount);
+                Calculation* calculations = client.data();
+                for (uint32_t job = 0; job < jobsPerConnection; ++job)
+                {
+                    for (uint32_t i = 0; i < elementCount; ++i)
+                        calculations[i] = { static_cast<float>(connection + job), static_cast<float>(i % 1000), 0.f };
+
+                    auto jobStart = std::chrono::high_resolution_clock::now();
+                    client.compute(elementCount);
+                    latencies[connection].push_back(
+                        std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - jobStart).count());
+
+                    for (uint32_t i = 0; i < elementCount; ++i)
+                    {
+                        if (calculations[i].res != calculations[i].f1 + calculations[i].f2)
+                            throw std::runtime_error("Server results do not match the CPU reference");
+                    }
+                }
+            }
+            catch (const std::runtime_error& err)
+            {
+                errors[connection] = err.what();
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    for (const std::string& error : errors)
+    {
+        if (!error.empty())
+            throw std::runtime_error(error);
+    }
+
+    std::vector<double> all;
+    for (const std::vector<double>& connectionLatencies : latencies)
+        all.insert(all.end(), connectionLatencies.begin(), connectionLatencies.end());
+    std::sort(all.begin(), all.end());
+    std::cout << "Client: " << all.size() << " jobs of " << elementCount << " elements over " << connectionCount
+              << " connections, median " << all[all.size() / 2] * 1e6 << " us, p99 " << all[all.size() * 99 / 100] * 1e6
+              << " us, " << all.size() / seconds << " jobs/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t elementCount = 1 << 22;
+    bool elementCountGiven = false;
+    // Split the batch over every suitable device instead of running on the best one
+    bool multiDevice = false;
+    bool cpu = false;
+    // Run on the GPU and the CPU backend and compare every result
+    bool crossCheck = false;
+    // Run the example compute graph instead of the single kernel
+    bool graph = false;
+    // Check reduce, scan, compaction and sort against the standard library
+    bool primitives = false;
+    // Stream a file of Calculations chunk by chunk, elementCount is then the chunk size
+    std::string streamInput, streamOutput;
+    // Stay resident and compute jobs sent to this socket
+    std::string serveSocket;
+    // Send jobs of elementCount Calculations to a server from this many connections
+    std::string clientSocket;
+    uint32_t clientConnections = 0;
+    // Ask the server on this socket to exit
+    std::string stopSocket;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+        {
+            serveSocket = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--client") == 0 && i + 2 < argc)
+        {
+            clientSocket = argv[++i];
+            clientConnections = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            if (clientConnections == 0)
+                clientConnections = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--stop") == 0 && i + 1 < argc)
+        {
+            stopSocket = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--stream") == 0 && i + 2 < argc)
+        {
+            streamInput = argv[++i];
+            streamOutput = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--multi-device") == 0)
+        {
+            multiDevice = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--cpu") == 0)
+        {
+            cpu = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--cross-check") == 0)
+        {
+            crossCheck = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--graph") == 0)
+        {
+            graph = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--primitives") == 0)
+        {
+            primitives = true;
+            continue;
+        }
+
+        char* end = nullptr;
+        unsigned long value = std::strtoul(argv[i], &end, 10);
+        if (end == argv[i] || *end != '\0' || value == 0 || value > UINT32_MAX)
+        {
+            std::cerr << "Usage: " << argv[0] << " [elementCount] [--multi-device | --cpu | --cross-check | --graph | --primitives | --stream <input> <output> | --serve <socket> | --client <socket> <connections> | --stop <socket>]" << std::endl;
+            return 1;
+        }
+        elementCount = static_cast<uint32_t>(value);
+        elementCountGiven = true;
+    }
+
     try
     {
-        Application app;
-        app.Run();
+        // Clients never touch a device
+        if (!clientSocket.empty())
+        {
+            runClients(clientSocket, clientConnections, elementCountGiven ? elementCount : 1 << 16);
+            return 0;
+        }
+        if (!stopSocket.empty())
+        {
+            if (!ComputeClient::requestShutdown(stopSocket))
+                throw std::runtime_error("No compute server is listening on " + stopSocket);
+            return 0;
+        }
+
+        if (!cpu && Application::findSuitableDevices().empty())
+        {
+            // Checks of the GPU kernels must not pass by running something else
+            if (graph || primitives || crossCheck)
+                throw std::runtime_error(std::string("No Vulkan device found, ") +
+                                         (graph ? "--graph" : primitives ? "--primitives" : "--cross-check") + " needs one");
+            std::cout << "No Vulkan device found, using the CPU backend" << std::endl;
+            cpu = true;
+            multiDevice = false;
+        }
+
+        if (!serveSocket.empty())
+        {
+            if (cpu)
+            {
+                CpuBackend cpuBackend;
+                runServer(cpuBackend, serveSocket);
+            }
+            else
+            {
+                Application app;
+                runServer(app, serveSocket);
+            }
+        }
+        else if (!streamInput.empty())
+        {
+            // Triple buffered, one chunk is read while one computes and one is written
+            uint32_t chunkElementCount = elementCountGiven ? elementCount : 1 << 20;
+            const uint32_t depth = 3;
+            if (cpu)
+            {
+                CpuBackend cpuBackend;
+                runStream(cpuBackend, streamInput, streamOutput, chunkElementCount, depth);
+            }
+            else
+            {
+                Application app;
+                app.setFramesInFlight(depth);
+                runStream(app, streamInput, streamOutput, chunkElementCount, depth);
+            }
+        }
+        else if (graph)
+        {
+            runGraphExample(elementCount);
+        }
+        else if (primitives)
+        {
+            runPrimitivesExample(elementCount, elementCountGiven);
+        }
+        else if (multiDevice)
+        {
+            DeviceGroup group;
+            group.Run(elementCount);
+        }
+        else if (crossCheck)
+        {
+            Application app;
+            CpuBackend cpuBackend;
+            CrossCheckBackend checked(app, cpuBackend);
+            checked.Run(elementCount);
+        }
+        else if (cpu)
+        {
+            CpuBackend cpuBackend;
+            cpuBackend.Run(elementCount);
+        }
+        else
+        {
+            Application app;
+            app.Run(elementCount);
+        }
     }
     catch (const std::runtime_error& err)
     {